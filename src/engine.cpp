@@ -0,0 +1,65 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "engine.h"
+
+namespace Stockfish {
+
+thread_local Engine* Engine::Current = nullptr;
+std::atomic<int> Engine::Count;
+
+
+/// Engine constructor sets the options to their default values, starts the
+/// threads and sets up the start position. The process wide tables must be
+/// initialized before the first engine is created, see main().
+
+Engine::Engine() : states(new std::deque<StateInfo>(1)) {
+
+  Scope scope(*this);
+
+  ++Count;
+  UCI::init(options);
+  threads.set(size_t(options["Threads"]));
+  Search::clear(); // After threads are up
+  UCI::execute("position startpos");
+}
+
+
+/// Engine destructor waits for the end of the search and terminates the threads
+
+Engine::~Engine() {
+
+  Scope scope(*this);
+
+  threads.set(0);
+  --Count;
+}
+
+
+/// Engine::command() executes a UCI command on this engine. It returns as
+/// soon as the command is processed, while a search keeps running on the
+/// engine threads until it is stopped or completed.
+
+void Engine::command(const std::string& cmd) {
+
+  Scope scope(*this);
+
+  UCI::execute(cmd);
+}
+
+} // namespace Stockfish
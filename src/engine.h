@@ -0,0 +1,101 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ENGINE_H_INCLUDED
+#define ENGINE_H_INCLUDED
+
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "timeman.h"
+#include "tt.h"
+#include "uci.h"
+
+namespace Stockfish {
+
+/// Engine class keeps together everything that makes an independently
+/// configured engine: its UCI options, thread pool, transposition table,
+/// search limits, time manager and current position. Several engines can
+/// live in the same process; the read-only tables (bitboards, NNUE network,
+/// Syzygy files) are shared by all of them.
+///
+/// Every thread works for one current engine, which is reached through the
+/// accessors below. Search threads belong to the engine that created them,
+/// other threads select an engine with an Engine::Scope.
+
+class Engine {
+
+  static thread_local Engine* Current;
+  static std::atomic<int> Count;
+
+public:
+  Engine();
+  ~Engine();
+  Engine(const Engine&) = delete;
+  Engine& operator=(const Engine&) = delete;
+
+  void command(const std::string& cmd);
+
+  static Engine& current() { assert(Current); return *Current; }
+  static int count() { return Count; }
+
+  /// Scope makes an engine the current one of the calling thread, until
+  /// the scope is left and the previous one is restored.
+
+  class Scope {
+  public:
+    explicit Scope(Engine& e) : previous(Current) { Current = &e; }
+    ~Scope() { Current = previous; }
+  private:
+    Engine* previous;
+  };
+
+  UCI::OptionsMap options;
+  ThreadPool threads;
+  TranspositionTable tt;
+  Search::LimitsType limits;
+  TimeManagement time;
+  Position pos;
+  StateListPtr states;
+
+  // Listeners of the search results. When they are set, e.g. by the library
+  // interface, they are called from the main search thread instead of
+  // printing the 'info' and 'bestmove' lines.
+  std::function<void(const std::vector<Search::InfoLine>&)> onInfo;
+  std::function<void(Move best, Move ponder)> onBestMove;
+};
+
+inline UCI::OptionsMap& Options() { return Engine::current().options; }
+inline ThreadPool& Threads() { return Engine::current().threads; }
+inline TranspositionTable& TT() { return Engine::current().tt; }
+inline TimeManagement& Time() { return Engine::current().time; }
+
+namespace Search {
+inline LimitsType& Limits() { return Engine::current().limits; }
+}
+
+} // namespace Stockfish
+
+#endif // #ifndef ENGINE_H_INCLUDED
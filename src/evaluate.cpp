@@ -28,6 +28,7 @@
 #include <vector>
 
 #include "bitboard.h"
+#include "engine.h"
 #include "evaluate.h"
 #include "material.h"
 #include "misc.h"
@@ -73,11 +74,11 @@ namespace Eval {
 
   void NNUE::init() {
 
-    useNNUE = Options["Use NNUE"];
+    useNNUE = Options()["Use NNUE"];
     if (!useNNUE)
         return;
 
-    string eval_file = string(Options["EvalFile"]);
+    string eval_file = string(Options()["EvalFile"]);
 
     #if defined(DEFAULT_NNUE_DIRECTORY)
     #define stringify2(x) #x
@@ -114,10 +115,11 @@ namespace Eval {
         }
   }
 
-  /// NNUE::verify() verifies that the last net used was loaded successfully
-  void NNUE::verify() {
+  /// NNUE::verify() verifies that the last net used was loaded successfully,
+  /// and reports the evaluation in use when requested.
+  void NNUE::verify(bool report) {
 
-    string eval_file = string(Options["EvalFile"]);
+    string eval_file = string(Options()["EvalFile"]);
 
     if (useNNUE && eval_file_loaded != eval_file)
     {
@@ -139,6 +141,9 @@ namespace Eval {
         exit(EXIT_FAILURE);
     }
 
+    if (!report)
+        return;
+
     if (useNNUE)
         sync_cout << "info string NNUE evaluation using " << eval_file << " enabled" << sync_endl;
     else
@@ -1084,7 +1089,12 @@ Value Eval::evaluate(const Position& pos) {
   Value v;
 
   if (!Eval::useNNUE)
+  {
       v = Evaluation<NO_TRACE>(pos).value();
+
+      if constexpr (SearchStatsEnabled)
+          pos.this_thread()->stats.classicalEvals++;
+  }
   else
   {
       // Scale and shift NNUE for compatibility with search and classical evaluation
@@ -1110,6 +1120,12 @@ Value Eval::evaluate(const Position& pos) {
 
       v = classical ? Evaluation<NO_TRACE>(pos).value()  // classical
                     : adjusted_NNUE();                   // NNUE
+
+      if constexpr (SearchStatsEnabled)
+      {
+          SearchStats& stats = pos.this_thread()->stats;
+          ++(classical ? stats.classicalEvals : stats.nnueEvals);
+      }
   }
 
   // Damp down the evaluation linearly when shuffling
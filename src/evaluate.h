@@ -47,7 +47,7 @@ namespace Eval {
     Value evaluate(const Position& pos, bool adjusted = false);
 
     void init();
-    void verify();
+    void verify(bool report = true);
 
     bool load_eval(std::string name, std::istream& stream);
     bool save_eval(std::ostream& stream);
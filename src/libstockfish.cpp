@@ -0,0 +1,268 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+#include "bitboard.h"
+#include "endgame.h"
+#include "engine.h"
+#include "evaluate.h"
+#include "libstockfish.h"
+#include "movegen.h"
+#include "position.h"
+#include "psqt.h"
+
+using namespace Stockfish;
+
+struct sf_engine {
+  Engine engine;
+};
+
+namespace {
+
+  const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+  std::once_flag TablesInit, NetInit;
+
+  // The process wide tables are initialized once, before the first engine
+  void init_tables() {
+
+    char name[] = "libstockfish";
+    char* argv[] = { name, nullptr };
+
+    CommandLine::init(1, argv);
+    PSQT::init();
+    Bitboards::init();
+    Position::init();
+    Bitbases::init();
+    Endgames::init();
+  }
+
+  // Converts a move to the encoding of the interface, see libstockfish.h
+  sf_move to_sf_move(Move m, bool chess960) {
+
+    if (m == MOVE_NONE || m == MOVE_NULL)
+        return 0;
+
+    Square from = from_sq(m), to = to_sq(m);
+
+    if (type_of(m) == CASTLING && !chess960)
+        to = make_square(to > from ? FILE_G : FILE_C, rank_of(from));
+
+    int promotion = type_of(m) == PROMOTION ? promotion_type(m) - KNIGHT + 1 : 0;
+
+    return sf_move(int(from) | int(to) << 6 | promotion << 12);
+  }
+
+  // Fills the interface struct from a line of the search output. The score
+  // is converted as in UCI::value().
+  void to_sf_info(const Search::InfoLine& line, const std::vector<sf_move>& pv, sf_info& info) {
+
+    Value v = line.score;
+    bool mate = abs(v) >= VALUE_MATE_IN_MAX_PLY;
+
+    info.depth      = line.depth;
+    info.seldepth   = line.selDepth;
+    info.multipv    = int(line.multiPV);
+    info.score_type = mate ? SF_SCORE_MATE : SF_SCORE_CP;
+    info.score      = mate ? (v > 0 ? VALUE_MATE - v + 1 : -VALUE_MATE - v) / 2 : v * 100 / PawnValueEg;
+    info.bound      =  line.bound == BOUND_LOWER ? SF_BOUND_LOWER
+                     : line.bound == BOUND_UPPER ? SF_BOUND_UPPER : SF_BOUND_EXACT;
+    info.nodes      = line.nodes;
+    info.nps        = line.nps;
+    info.tbhits     = line.tbHits;
+    info.hashfull   = line.hashfull;
+    info.time       = line.time;
+    info.pv         = pv.data();
+    info.pv_length  = pv.size();
+  }
+
+} // namespace
+
+
+sf_engine* sf_engine_new() {
+
+  std::call_once(TablesInit, init_tables);
+
+  sf_engine* e = new sf_engine();
+
+  // The net is shared by all the engines, it is loaded with the options of the first one
+  std::call_once(NetInit, [e]() {
+      Engine::Scope scope(e->engine);
+      Eval::NNUE::init();
+  });
+
+  return e;
+}
+
+
+void sf_engine_free(sf_engine* e) {
+
+  delete e;
+}
+
+
+int sf_set_option(sf_engine* e, const char* name, const char* value) {
+
+  Engine::Scope scope(e->engine);
+
+  if (!Options().count(name) || !Options()[name].accepts(value))
+      return -1;
+
+  Options()[name] = std::string(value);
+  return 0;
+}
+
+
+int sf_set_position(sf_engine* e, const char* fen, const sf_move* moves, size_t count) {
+
+  Engine::Scope scope(e->engine);
+  Position& pos = e->engine.pos;
+  StateListPtr& states = e->engine.states;
+  bool chess960 = Options()["UCI_Chess960"];
+
+  Threads().main()->wait_for_search_finished();
+
+  states = StateListPtr(new std::deque<StateInfo>(1)); // Drop old and create a new one
+  pos.set(fen ? fen : StartFEN, chess960, &states->back(), Threads().main());
+
+  for (size_t i = 0; i < count; ++i)
+  {
+      Move m = MOVE_NONE;
+
+      for (const auto& lm : MoveList<LEGAL>(pos))
+          if (to_sf_move(lm, chess960) == moves[i])
+          {
+              m = lm;
+              break;
+          }
+
+      if (m == MOVE_NONE)
+          return -1;
+
+      states->emplace_back();
+      pos.do_move(m, states->back());
+  }
+
+  return 0;
+}
+
+
+sf_move sf_search(sf_engine* e, const sf_limits* limits,
+                  sf_info_callback callback, void* user, sf_move* ponder) {
+
+  Engine& engine = e->engine;
+  Engine::Scope scope(engine);
+  Search::LimitsType l;
+  Move bestMove = MOVE_NONE, ponderMove = MOVE_NONE;
+  bool chess960 = engine.pos.is_chess960();
+  std::vector<sf_move> pv;
+
+  l.startTime = now(); // As early as possible!
+
+  if (limits)
+  {
+      l.depth       = limits->depth;
+      l.nodes       = limits->nodes;
+      l.movetime    = limits->movetime;
+      l.time[WHITE] = limits->time[WHITE];
+      l.time[BLACK] = limits->time[BLACK];
+      l.inc[WHITE]  = limits->inc[WHITE];
+      l.inc[BLACK]  = limits->inc[BLACK];
+      l.movestogo   = limits->movestogo;
+      l.mate        = limits->mate;
+  }
+
+  // The listeners are called from the main search thread, while we wait here
+  engine.onInfo = [&](const std::vector<Search::InfoLine>& lines) {
+      if (!callback)
+          return;
+
+      for (const auto& line : lines)
+      {
+          sf_info info;
+          pv.clear();
+          for (Move m : line.pv)
+              pv.push_back(to_sf_move(m, chess960));
+
+          to_sf_info(line, pv, info);
+          callback(&info, user);
+      }
+  };
+  engine.onBestMove = [&](Move best, Move p) { bestMove = best, ponderMove = p; };
+
+  Threads().start_thinking(engine.pos, engine.states, l);
+  Threads().main()->wait_for_search_finished();
+
+  engine.onInfo = nullptr;
+  engine.onBestMove = nullptr;
+
+  if (ponder)
+      *ponder = to_sf_move(ponderMove, chess960);
+
+  return to_sf_move(bestMove, chess960);
+}
+
+
+void sf_stop(sf_engine* e) {
+
+  e->engine.threads.stop = true;
+}
+
+
+int sf_eval(sf_engine* e, int* score) {
+
+  Engine::Scope scope(e->engine);
+  Position& pos = e->engine.pos;
+
+  if (pos.checkers())
+      return -1;
+
+  Eval::NNUE::verify(false);
+
+  pos.this_thread()->trend = SCORE_ZERO; // Reset any dynamic contempt
+
+  *score = Eval::evaluate(pos) * 100 / PawnValueEg;
+  return 0;
+}
+
+
+void sf_move_to_uci(sf_move move, char* buf) {
+
+  const char* promotions = " nbrq";
+  Square from = Square(move & 0x3F), to = Square((move >> 6) & 0x3F);
+  int promotion = (move >> 12) & 7;
+  char* p = buf;
+
+  if (!move)
+  {
+      std::strcpy(buf, "0000");
+      return;
+  }
+
+  *p++ = char('a' + file_of(from)), *p++ = char('1' + rank_of(from));
+  *p++ = char('a' + file_of(to)),   *p++ = char('1' + rank_of(to));
+
+  if (promotion >= 1 && promotion <= 4)
+      *p++ = promotions[promotion];
+
+  *p = '\0';
+}
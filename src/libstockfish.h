@@ -0,0 +1,106 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBSTOCKFISH_H_INCLUDED
+#define LIBSTOCKFISH_H_INCLUDED
+
+/// C interface of the engine, built with 'make lib'. It drives an engine
+/// without going through the text UCI protocol: positions, limits and search
+/// results are passed as plain structs. Every engine has its own options,
+/// threads and hash table; one engine must be used by one caller thread at a
+/// time, except for sf_stop() which may be called from any thread.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sf_engine sf_engine;
+
+/// A move is encoded as from | to << 6 | promotion << 12, with the squares
+/// numbered from a1 = 0 to h8 = 63, and the promotion piece 0 (none),
+/// 1 (knight), 2 (bishop), 3 (rook) or 4 (queen). Castling is the king move
+/// to its destination square, or king takes own rook in Chess960. Zero is
+/// the null move.
+typedef uint16_t sf_move;
+
+enum { SF_SCORE_CP, SF_SCORE_MATE };
+enum { SF_BOUND_EXACT, SF_BOUND_LOWER, SF_BOUND_UPPER };
+
+/// Search limits, a zero field is not used. Without any limit the search
+/// runs until sf_stop() is called.
+typedef struct {
+  int     depth;
+  int64_t nodes;
+  int64_t movetime;      // Milliseconds
+  int64_t time[2], inc[2]; // Clock of white and black, in milliseconds
+  int     movestogo;
+  int     mate;
+} sf_limits;
+
+/// One line of the search output, as sent by the UCI 'info' command
+typedef struct {
+  int      depth, seldepth, multipv;
+  int      score_type;  // SF_SCORE_CP or SF_SCORE_MATE
+  int      score;       // Centipawns, or moves to mate (negative when mated)
+  int      bound;       // SF_BOUND_*
+  uint64_t nodes, nps, tbhits;
+  int      hashfull;    // Per mille, -1 when not available
+  int64_t  time;        // Milliseconds
+  const sf_move* pv;
+  size_t   pv_length;
+} sf_info;
+
+typedef void (*sf_info_callback)(const sf_info* info, void* user);
+
+sf_engine* sf_engine_new(void);
+void sf_engine_free(sf_engine* engine);
+
+/// Sets a UCI option, returns 0 on success and -1 if the option is unknown or
+/// the value is not valid for it, in which case the option is not changed
+int sf_set_option(sf_engine* engine, const char* name, const char* value);
+
+/// Sets the position from a FEN, or the start position if fen is NULL, and
+/// plays the given moves. Returns 0 on success, or -1 if a move is illegal,
+/// in which case the position is left before that move.
+int sf_set_position(sf_engine* engine, const char* fen, const sf_move* moves, size_t count);
+
+/// Searches the current position and returns the best move, 0 if there is
+/// no legal move. The callback, if any, receives every PV update from the
+/// search thread. The ponder move is stored if ponder is not NULL.
+sf_move sf_search(sf_engine* engine, const sf_limits* limits,
+                  sf_info_callback callback, void* user, sf_move* ponder);
+
+/// Stops the running search of the engine, which then returns its result
+void sf_stop(sf_engine* engine);
+
+/// Static evaluation of the current position in centipawns, from the side
+/// to move point of view. Returns -1 when the side to move is in check.
+int sf_eval(sf_engine* engine, int* score);
+
+/// Writes the move in UCI notation to buf, which holds at least 6 chars
+void sf_move_to_uci(sf_move move, char* buf);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // #ifndef LIBSTOCKFISH_H_INCLUDED
@@ -20,6 +20,7 @@
 
 #include "bitboard.h"
 #include "endgame.h"
+#include "engine.h"
 #include "position.h"
 #include "psqt.h"
 #include "search.h"
@@ -35,19 +36,19 @@ int main(int argc, char* argv[]) {
   std::cout << engine_info() << std::endl;
 
   CommandLine::init(argc, argv);
-  UCI::init(Options);
-  Tune::init();
   PSQT::init();
   Bitboards::init();
   Position::init();
   Bitbases::init();
   Endgames::init();
-  Threads.set(size_t(Options["Threads"]));
-  Search::clear(); // After threads are up
+
+  Engine engine;
+  Engine::Scope scope(engine);
+
+  Tune::init(); // After the options are up
   Eval::NNUE::init();
 
   UCI::loop(argc, argv);
 
-  Threads.set(0);
   return 0;
 }
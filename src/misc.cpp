@@ -39,16 +39,29 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <vector>
 #include <cstdlib>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <sched.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(MAP_HUGETLB)
+#define HAS_HUGETLB
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#endif
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) || (defined(__GLIBCXX__) && !defined(_GLIBCXX_HAVE_ALIGNED_ALLOC) && !defined(_WIN32)) || defined(__e2k__)
@@ -261,6 +274,15 @@ std::string compiler_info() {
     compiler += " NEON";
   #endif
 
+  #if defined(TT_LOCKLESS)
+    compiler += " LOCKLESS";
+  #endif
+  #if defined(TT_CLUSTER_64)
+    compiler += " CLUSTER64";
+  #elif defined(TT_CLUSTER_64_WIDE)
+    compiler += " CLUSTER64WIDE";
+  #endif
+
   #if !defined(NDEBUG)
     compiler += " DEBUG";
   #endif
@@ -372,6 +394,50 @@ void std_aligned_free(void* ptr) {
 }
 
 /// aligned_large_pages_alloc() will return suitably aligned memory, if possible using large pages.
+/// On Linux, a non-zero hugePageSize (2MB or 1GB) asks for explicit huge pages from
+/// the hugetlbfs pool, with a fallback to the smaller size and then to transparent
+/// huge pages. Explicit huge pages must be reserved by the administrator beforehand,
+/// e.g. with 'echo 1024 > /proc/sys/vm/nr_hugepages' for 2GB of 2MB pages.
+
+#if defined(HAS_HUGETLB)
+
+namespace {
+
+  // Explicit huge pages are mapped with mmap(), so that their size must be
+  // remembered to unmap them. Maps the address to the size and the page size.
+  // Never destroyed, because the global TT is freed at exit, possibly after
+  // the static objects of this file.
+  struct HugetlbMappings {
+    std::mutex mutex;
+    std::map<const void*, std::pair<size_t, size_t>> sizes;
+  };
+
+  HugetlbMappings& hugetlb_mappings() {
+    static HugetlbMappings* mappings = new HugetlbMappings();
+    return *mappings;
+  }
+
+  void* hugetlb_alloc(size_t allocSize, size_t pageSize) {
+
+    const size_t size = (allocSize + pageSize - 1) / pageSize * pageSize;
+    int log2PageSize = 0;
+
+    while ((size_t(1) << log2PageSize) < pageSize)
+        ++log2PageSize;
+
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (log2PageSize << MAP_HUGE_SHIFT), -1, 0);
+
+    if (mem == MAP_FAILED)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lk(hugetlb_mappings().mutex);
+    hugetlb_mappings().sizes[mem] = { size, pageSize };
+    return mem;
+  }
+}
+
+#endif
 
 #if defined(_WIN32)
 
@@ -426,7 +492,7 @@ static void* aligned_large_pages_alloc_windows(size_t allocSize) {
   #endif
 }
 
-void* aligned_large_pages_alloc(size_t allocSize) {
+void* aligned_large_pages_alloc(size_t allocSize, size_t) {
 
   // Try to allocate large pages
   void* mem = aligned_large_pages_alloc_windows(allocSize);
@@ -440,7 +506,15 @@ void* aligned_large_pages_alloc(size_t allocSize) {
 
 #else
 
-void* aligned_large_pages_alloc(size_t allocSize) {
+void* aligned_large_pages_alloc(size_t allocSize, size_t hugePageSize) {
+
+#if defined(HAS_HUGETLB)
+  for (size_t pageSize = hugePageSize; pageSize >= 2 * 1024 * 1024; pageSize /= 512)
+      if (void* mem = hugetlb_alloc(allocSize, pageSize))
+          return mem;
+#else
+  (void)hugePageSize;
+#endif
 
 #if defined(__linux__)
   constexpr size_t alignment = 2 * 1024 * 1024; // assumed 2MB page size
@@ -479,12 +553,46 @@ void aligned_large_pages_free(void* mem) {
 #else
 
 void aligned_large_pages_free(void *mem) {
+
+#if defined(HAS_HUGETLB)
+  HugetlbMappings& m = hugetlb_mappings();
+  std::lock_guard<std::mutex> lk(m.mutex);
+  auto it = m.sizes.find(mem);
+
+  if (it != m.sizes.end())
+  {
+      munmap(mem, it->second.first);
+      m.sizes.erase(it);
+      return;
+  }
+#endif
+
   std_aligned_free(mem);
 }
 
 #endif
 
 
+/// huge_page_size() returns the size of the explicit huge pages of a block
+/// returned by aligned_large_pages_alloc(), or 0 if it uses regular pages.
+
+size_t huge_page_size(const void* mem) {
+
+#if defined(HAS_HUGETLB)
+  HugetlbMappings& m = hugetlb_mappings();
+  std::lock_guard<std::mutex> lk(m.mutex);
+  auto it = m.sizes.find(mem);
+
+  if (it != m.sizes.end())
+      return it->second.second;
+#else
+  (void)mem;
+#endif
+
+  return 0;
+}
+
+
 namespace WinProcGroup {
 
 #ifndef _WIN32
@@ -591,6 +699,170 @@ void bindThisThread(size_t idx) {
 
 } // namespace WinProcGroup
 
+
+namespace Numa {
+
+#if defined(__linux__) && !defined(__ANDROID__) && defined(SYS_mbind)
+
+namespace {
+
+// Memory policies of the mbind() syscall, see linux/mempolicy.h
+constexpr int MPOL_BIND_       = 2;
+constexpr int MPOL_INTERLEAVE_ = 3;
+
+constexpr size_t MaskBits = 8 * sizeof(unsigned long);
+
+struct Node {
+  int id;
+  std::vector<int> cpus;
+};
+
+/// parse_list() converts a sysfs list like "0-7,16-23" into the list of its values
+
+std::vector<int> parse_list(const string& fname) {
+
+  std::vector<int> values;
+  ifstream file(fname);
+  string token;
+
+  while (getline(file, token, ','))
+  {
+      int first, last;
+      char dash;
+      istringstream ss(token);
+
+      if (!(ss >> first))
+          break;
+
+      last = (ss >> dash >> last) ? last : first;
+
+      for (int v = first; v <= last; ++v)
+          values.push_back(v);
+  }
+
+  return values;
+}
+
+/// topology() returns the NUMA nodes that have at least one CPU. The sysfs
+/// files are read only once, at the first call.
+
+const std::vector<Node>& topology() {
+
+  static const std::vector<Node> nodes = [] {
+
+      std::vector<Node> v;
+      for (int id : parse_list("/sys/devices/system/node/online"))
+      {
+          auto cpus = parse_list("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+          if (!cpus.empty())
+              v.push_back({ id, cpus });
+      }
+      return v;
+  }();
+
+  return nodes;
+}
+
+/// mbind() applies the memory policy to the pages fully or partially covered
+/// by [mem, mem + size). The nodes are given as a bit mask of node ids.
+
+void mbind(void* mem, size_t size, int mode, const std::vector<unsigned long>& mask) {
+
+  const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+  const uintptr_t start = uintptr_t(mem) & ~(pageSize - 1);
+  const uintptr_t end   = uintptr_t(mem) + size;
+
+  // The kernel ignores the last bit of maxnode, hence the + 1
+  syscall(SYS_mbind, start, end - start, mode, mask.data(), mask.size() * MaskBits + 1, 0);
+}
+
+void set_bit(std::vector<unsigned long>& mask, int id) {
+
+  if (mask.size() <= size_t(id) / MaskBits)
+      mask.resize(id / MaskBits + 1, 0);
+
+  mask[id / MaskBits] |= 1UL << (id % MaskBits);
+}
+
+} // namespace
+
+
+/// nodeCount() returns the number of NUMA nodes with at least one CPU
+
+size_t nodeCount() {
+  return std::max(topology().size(), size_t(1));
+}
+
+
+/// nodeOf() returns the node assigned to the thread with index idx. Threads
+/// are spread round-robin, so that each node gets the same share of the search.
+
+size_t nodeOf(size_t idx) {
+  return idx % nodeCount();
+}
+
+
+/// bindThisThread() restricts the current thread to the CPUs of its node.
+/// Memory first touched by the thread is then allocated on the same node.
+
+void bindThisThread(size_t idx) {
+
+  if (nodeCount() < 2)
+      return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  for (int cpu : topology()[nodeOf(idx)].cpus)
+      if (cpu < CPU_SETSIZE)
+          CPU_SET(cpu, &set);
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &set);
+}
+
+
+/// interleaveMemory() spreads the pages of the given memory across all the
+/// nodes. It must be called before the memory is touched for the first time.
+
+void interleaveMemory(void* mem, size_t size) {
+
+  if (nodeCount() < 2)
+      return;
+
+  std::vector<unsigned long> mask;
+  for (const Node& n : topology())
+      set_bit(mask, n.id);
+
+  mbind(mem, size, MPOL_INTERLEAVE_, mask);
+}
+
+
+/// bindMemory() places the pages of the given memory on a single node. It must
+/// be called before the memory is touched for the first time.
+
+void bindMemory(void* mem, size_t size, size_t node) {
+
+  if (nodeCount() < 2)
+      return;
+
+  std::vector<unsigned long> mask;
+  set_bit(mask, topology()[node].id);
+
+  mbind(mem, size, MPOL_BIND_, mask);
+}
+
+#else
+
+size_t nodeCount() { return 1; }
+size_t nodeOf(size_t) { return 0; }
+void bindThisThread(size_t) {}
+void interleaveMemory(void*, size_t) {}
+void bindMemory(void*, size_t, size_t) {}
+
+#endif
+
+} // namespace Numa
+
 #ifdef _WIN32
 #include <direct.h>
 #define GETCWD _getcwd
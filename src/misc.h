@@ -36,8 +36,9 @@ void prefetch(void* addr);
 void start_logger(const std::string& fname);
 void* std_aligned_alloc(size_t alignment, size_t size);
 void std_aligned_free(void* ptr);
-void* aligned_large_pages_alloc(size_t size); // memory aligned by page size, min alignment: 4096 bytes
+void* aligned_large_pages_alloc(size_t size, size_t hugePageSize = 0); // memory aligned by page size, min alignment: 4096 bytes
 void aligned_large_pages_free(void* mem); // nop if mem == nullptr
+size_t huge_page_size(const void* mem); // size of the explicit huge pages backing mem, 0 if none
 
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
@@ -54,9 +55,10 @@ inline TimePoint now() {
 template<class Entry, int Size>
 struct HashTable {
   Entry* operator[](Key key) { return &table[(uint32_t)key & (Size - 1)]; }
+  void clear() { table = std::vector<Entry>(Size); }
 
 private:
-  std::vector<Entry> table = std::vector<Entry>(Size); // Allocate on the heap
+  std::vector<Entry> table; // Allocated on the heap by clear(), before first use
 };
 
 
@@ -188,6 +190,20 @@ namespace WinProcGroup {
   void bindThisThread(size_t idx);
 }
 
+/// On Linux, big machines usually have more than one NUMA node and the memory
+/// is placed by the kernel on the node of the thread that first touches it.
+/// The Numa namespace reads the node topology from sysfs and calls the mbind()
+/// syscall directly, so that no dependency on libnuma is needed. On other
+/// systems the functions do nothing and a single node is reported.
+
+namespace Numa {
+  size_t nodeCount();
+  size_t nodeOf(size_t idx);
+  void bindThisThread(size_t idx);
+  void interleaveMemory(void* mem, size_t size);
+  void bindMemory(void* mem, size_t size, size_t node);
+}
+
 namespace CommandLine {
   void init(int argc, char* argv[]);
 
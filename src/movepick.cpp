@@ -67,10 +67,15 @@ MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHist
           !(ttm && pos.pseudo_legal(ttm));
 }
 
-/// MovePicker constructor for quiescence search
+/// MovePicker constructor for quiescence search. When the qsearch table of the
+/// thread is given, the entries of all the captures are prefetched as soon as they are
+/// generated, so that the cache misses overlap instead of each one stalling the
+/// probe of its child node.
 MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHistory* mh,
-                       const CapturePieceToHistory* cph, const PieceToHistory** ch, Square rs)
-           : pos(p), mainHistory(mh), captureHistory(cph), continuationHistory(ch), ttMove(ttm), recaptureSquare(rs), depth(d) {
+                       const CapturePieceToHistory* cph, const PieceToHistory** ch, Square rs,
+                       const QSearchTable* qst)
+           : pos(p), mainHistory(mh), captureHistory(cph), continuationHistory(ch), qsTable(qst),
+             ttMove(ttm), recaptureSquare(rs), depth(d) {
 
   assert(d <= 0);
 
@@ -165,6 +170,11 @@ top:
       endMoves = generate<CAPTURES>(pos, cur);
 
       score<CAPTURES>();
+
+      if (qsTable)
+          for (auto& m : *this)
+              qsTable->prefetch(pos.key_after(m));
+
       ++stage;
       goto top;
 
@@ -25,6 +25,7 @@
 
 #include "movegen.h"
 #include "position.h"
+#include "tt.h"
 #include "types.h"
 
 namespace Stockfish {
@@ -78,6 +79,22 @@ struct Stats : public std::array<Stats<T, D, Sizes...>, Size>
 template <typename T, int D, int Size>
 struct Stats<T, D, Size> : public std::array<StatsEntry<T, D>, Size> {};
 
+/// PieceStats is a Stats table whose first index is a piece. The piece codes are
+/// compacted to PIECE_HIST_NB indices, skipping the codes 7, 8 and 15, which are
+/// not used by any piece. This cuts the continuation histories by a third.
+constexpr int PIECE_HIST_NB = 13;
+
+template <typename T, int D, int... Sizes>
+struct PieceStats : public Stats<T, D, PIECE_HIST_NB, Sizes...> {
+
+  typedef Stats<T, D, PIECE_HIST_NB, Sizes...> stats;
+
+  static constexpr int index(Piece pc) { return pc - 2 * (pc >> 3); }
+
+  auto& operator[](Piece pc) { return stats::operator[](index(pc)); }
+  const auto& operator[](Piece pc) const { return stats::operator[](index(pc)); }
+};
+
 /// In stats table, D=0 means that the template parameter is not used
 enum StatsParams { NOT_USED = 0 };
 enum StatsType { NoCaptures, Captures };
@@ -96,18 +113,18 @@ typedef Stats<int16_t, 10692, MAX_LPH, int(SQUARE_NB) * int(SQUARE_NB)> LowPlyHi
 
 /// CounterMoveHistory stores counter moves indexed by [piece][to] of the previous
 /// move, see www.chessprogramming.org/Countermove_Heuristic
-typedef Stats<Move, NOT_USED, PIECE_NB, SQUARE_NB> CounterMoveHistory;
+typedef PieceStats<Move, NOT_USED, SQUARE_NB> CounterMoveHistory;
 
 /// CapturePieceToHistory is addressed by a move's [piece][to][captured piece type]
-typedef Stats<int16_t, 10692, PIECE_NB, SQUARE_NB, PIECE_TYPE_NB> CapturePieceToHistory;
+typedef PieceStats<int16_t, 10692, SQUARE_NB, PIECE_TYPE_NB> CapturePieceToHistory;
 
 /// PieceToHistory is like ButterflyHistory but is addressed by a move's [piece][to]
-typedef Stats<int16_t, 29952, PIECE_NB, SQUARE_NB> PieceToHistory;
+typedef PieceStats<int16_t, 29952, SQUARE_NB> PieceToHistory;
 
 /// ContinuationHistory is the combined history of a given pair of moves, usually
 /// the current one given a previous one. The nested history table is based on
 /// PieceToHistory instead of ButterflyBoards.
-typedef Stats<PieceToHistory, NOT_USED, PIECE_NB, SQUARE_NB> ContinuationHistory;
+typedef PieceStats<PieceToHistory, NOT_USED, SQUARE_NB> ContinuationHistory;
 
 
 /// MovePicker class is used to pick one pseudo-legal move at a time from the
@@ -127,7 +144,8 @@ public:
   MovePicker(const Position&, Move, Depth, const ButterflyHistory*,
                                            const CapturePieceToHistory*,
                                            const PieceToHistory**,
-                                           Square);
+                                           Square,
+                                           const QSearchTable* = nullptr);
   MovePicker(const Position&, Move, Depth, const ButterflyHistory*,
                                            const LowPlyHistory*,
                                            const CapturePieceToHistory*,
@@ -148,6 +166,7 @@ private:
   const LowPlyHistory* lowPlyHistory;
   const CapturePieceToHistory* captureHistory;
   const PieceToHistory** continuationHistory;
+  const QSearchTable* qsTable = nullptr;
   Move ttMove;
   ExtMove refutations[3], *cur, *endMoves, *endBadCaptures;
   int stage;
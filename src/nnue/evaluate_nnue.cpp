@@ -27,6 +27,7 @@
 #include "../evaluate.h"
 #include "../position.h"
 #include "../misc.h"
+#include "../thread.h"
 #include "../uci.h"
 #include "../types.h"
 
@@ -160,8 +161,11 @@ namespace Stockfish::Eval::NNUE {
     ASSERT_ALIGNED(transformedFeatures, alignment);
     ASSERT_ALIGNED(buffer, alignment);
 
+    SearchStats& stats = pos.this_thread()->stats;
     const std::size_t bucket = (pos.count<ALL_PIECES>() - 1) / 4;
-    const auto psqt = featureTransformer->transform(pos, transformedFeatures, bucket);
+    const auto psqt = featureTransformer->transform(pos, transformedFeatures, bucket,
+                                                    SearchStatsEnabled ? &stats.accumulatorUpdates : nullptr,
+                                                    SearchStatsEnabled ? &stats.accumulatorRefreshes : nullptr);
     const auto output = network[bucket]->propagate(transformedFeatures, buffer);
 
     int materialist = psqt;
@@ -209,10 +213,13 @@ namespace Stockfish::Eval::NNUE {
     ASSERT_ALIGNED(transformedFeatures, alignment);
     ASSERT_ALIGNED(buffer, alignment);
 
+    SearchStats& stats = pos.this_thread()->stats;
     NnueEvalTrace t{};
     t.correctBucket = (pos.count<ALL_PIECES>() - 1) / 4;
     for (std::size_t bucket = 0; bucket < LayerStacks; ++bucket) {
-      const auto psqt = featureTransformer->transform(pos, transformedFeatures, bucket);
+      const auto psqt = featureTransformer->transform(pos, transformedFeatures, bucket,
+                                                      SearchStatsEnabled ? &stats.accumulatorUpdates : nullptr,
+                                                      SearchStatsEnabled ? &stats.accumulatorRefreshes : nullptr);
       const auto output = network[bucket]->propagate(transformedFeatures, buffer);
 
       int materialist = psqt;
@@ -214,10 +214,12 @@ namespace Stockfish::Eval::NNUE {
       return !stream.fail();
     }
 
-    // Convert input features
-    std::int32_t transform(const Position& pos, OutputType* output, int bucket) const {
-      update_accumulator(pos, WHITE);
-      update_accumulator(pos, BLACK);
+    // Convert input features, counting the accumulator updates and refreshes
+    // when the counters are given
+    std::int32_t transform(const Position& pos, OutputType* output, int bucket,
+                           std::uint64_t* updates, std::uint64_t* refreshes) const {
+      update_accumulator(pos, WHITE, updates, refreshes);
+      update_accumulator(pos, BLACK, updates, refreshes);
 
       const Color perspectives[2] = {pos.side_to_move(), ~pos.side_to_move()};
       const auto& accumulation = pos.state()->accumulator.accumulation;
@@ -364,7 +366,8 @@ namespace Stockfish::Eval::NNUE {
 
 
    private:
-    void update_accumulator(const Position& pos, const Color perspective) const {
+    void update_accumulator(const Position& pos, const Color perspective,
+                            std::uint64_t* updates, std::uint64_t* refreshes) const {
 
       // The size must be enough to contain the largest possible update.
       // That might depend on the feature set and generally relies on the
@@ -411,6 +414,9 @@ namespace Stockfish::Eval::NNUE {
           FeatureSet::append_changed_indices(
             ksq, st2, perspective, removed[1], added[1]);
 
+        if (updates)
+            ++*updates;
+
         // Mark the accumulators as computed.
         next->accumulator.computed[perspective] = true;
         pos.state()->accumulator.computed[perspective] = true;
@@ -532,6 +538,8 @@ namespace Stockfish::Eval::NNUE {
       else
       {
         // Refresh the accumulator
+        if (refreshes)
+            ++*refreshes;
         auto& accumulator = pos.state()->accumulator;
         accumulator.computed[perspective] = true;
         IndexList active;
@@ -24,6 +24,7 @@
 #include <sstream>
 
 #include "bitboard.h"
+#include "engine.h"
 #include "misc.h"
 #include "movegen.h"
 #include "position.h"
@@ -1013,7 +1014,7 @@ void Position::do_null_move(StateInfo& newSt) {
   }
 
   st->key ^= Zobrist::side;
-  prefetch(TT.first_entry(key()));
+  prefetch(TT().first_entry(key()));
 
   ++st->rule50;
   st->pliesFromNull = 0;
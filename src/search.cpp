@@ -22,7 +22,9 @@
 #include <cstring>   // For std::memset
 #include <iostream>
 #include <sstream>
+#include <thread>
 
+#include "engine.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "movegen.h"
@@ -37,11 +39,6 @@
 
 namespace Stockfish {
 
-namespace Search {
-
-  LimitsType Limits;
-}
-
 namespace Tablebases {
 
   int Cardinality;
@@ -86,11 +83,30 @@ namespace {
     return d > 14 ? 73 : 6 * d * d + 229 * d - 215;
   }
 
+  // Sends the PV lines to the listener of the engine, or prints them for the GUI
+  void report_pv(const Position& pos, Depth depth, Value alpha, Value beta) {
+
+    Engine& engine = Engine::current();
+
+    if (engine.onInfo)
+        engine.onInfo(Search::info_lines(pos, depth, alpha, beta));
+    else
+        sync_cout << UCI::pv(pos, depth, alpha, beta) << sync_endl;
+  }
+
   // Add a small random component to draw evaluations to avoid 3-fold blindness
   Value value_draw(Thread* thisThread) {
     return VALUE_DRAW + Value(2 * (thisThread->nodes & 1) - 1);
   }
 
+  // A search is stopped when all threads are told to stop or, when analyzing
+  // a batch, when this thread has reached the node limit of its own position.
+  bool stopped(const Thread* thisThread) {
+    const ThreadPool& threads = thisThread->threads();
+    return threads.deterministic ? threads.quantum.stop
+                                 : threads.stop.load(std::memory_order_relaxed) || thisThread->stopBatch;
+  }
+
   // Skill structure is used to implement strength limit
   struct Skill {
     explicit Skill(int l) : level(l) {}
@@ -116,32 +132,158 @@ namespace {
   void update_all_stats(const Position& pos, Stack* ss, Move bestMove, Value bestValue, Value beta, Square prevSq,
                         Move* quietsSearched, int quietCount, Move* capturesSearched, int captureCount, Depth depth);
 
+  // In the 'abdada' SMP mode, non-PV nodes from MarkDepth on are marked while
+  // searched, and from DeferDepth on the moves to a node marked by another
+  // thread are deferred until the other moves have been searched.
+  constexpr Depth MarkDepth = 5;
+  constexpr Depth DeferDepth = 6;
+  constexpr int MaxDeferred = 32;
+
+  // NodeMarker sets the mark of a node for the lifetime of the object, unless
+  // the slot of its key is already taken by another node or thread.
+  struct NodeMarker {
+
+    NodeMarker(Thread* th, Key key, bool active) {
+
+      mark = active ? &th->threads().nodeMarks[key & (ThreadPool::NodeMarkCount - 1)] : nullptr;
+
+      Thread* expected = nullptr;
+
+      if (mark && mark->thread.compare_exchange_strong(expected, th, std::memory_order_relaxed))
+          mark->key.store(key, std::memory_order_relaxed);
+      else
+          mark = nullptr;
+    }
+
+    ~NodeMarker() { if (mark) mark->thread.store(nullptr, std::memory_order_relaxed); }
+
+  private:
+    NodeMark* mark;
+  };
+
+  // marked_by_other() returns true if the node of the given key is being
+  // searched by another thread.
+  bool marked_by_other(Thread* th, Key key) {
+
+    const NodeMark& mark = th->threads().nodeMarks[key & (ThreadPool::NodeMarkCount - 1)];
+    Thread* other = mark.thread.load(std::memory_order_relaxed);
+
+    return other && other != th && mark.key.load(std::memory_order_relaxed) == key;
+  }
+
   // perft() is our utility to verify move generation. All the leaf nodes up
   // to the given depth are generated and counted, and the sum is returned.
-  template<bool Root>
-  uint64_t perft(Position& pos, Depth depth) {
+  // Above depth 1, the counts are cached in the perft hash table if enabled.
+  uint64_t perft(Position& pos, Depth depth, PerftTable& table) {
+
+    if (depth <= 1)
+        return depth == 1 ? MoveList<LEGAL>(pos).size() : 1;
+
+    const bool hashed = table.enabled();
+    uint64_t nodes = 0;
+
+    if (hashed && table.probe(pos.key(), depth, nodes))
+        return nodes;
 
     StateInfo st;
     ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
-    uint64_t cnt, nodes = 0;
-    const bool leaf = (depth == 2);
+    for (const auto& m : MoveList<LEGAL>(pos))
+    {
+        pos.do_move(m, st);
+        nodes += perft(pos, depth - 1, table);
+        pos.undo_move(m);
+    }
+
+    if (hashed)
+        table.save(pos.key(), depth, nodes);
+
+    return nodes;
+  }
+
+  // perft_split() lists the pairs of a root move and one of its replies, which
+  // are then counted in parallel by perft_worker(). Shallower perfts are not
+  // split and leave the list empty.
+  void perft_split(Position& pos, Depth depth) {
+
+    PerftSplit& split = Threads().perftSplit;
+    StateInfo st;
+    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
+
+    split.moves.clear();
+    split.next = 0;
+
+    if (depth >= 3)
+        for (const auto& m : MoveList<LEGAL>(pos))
+        {
+            pos.do_move(m, st);
+            for (const auto& r : MoveList<LEGAL>(pos))
+                split.moves.emplace_back(m, r);
+            pos.undo_move(m);
+        }
+
+    split.counts.assign(split.moves.size(), 0);
+  }
+
+  // perft_worker() is run by every thread of the pool, and counts the leaf nodes
+  // below the pairs of moves it claims until the split is exhausted.
+  void perft_worker(Thread* th, Depth depth) {
+
+    PerftSplit& split = Threads().perftSplit;
+    PerftTable& table = Threads().perftTable;
+    Position& pos = th->rootPos;
+    StateInfo st[2];
+    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
+
+    for (size_t i; (i = split.next++) < split.moves.size(); )
+    {
+        const auto [m, r] = split.moves[i];
+
+        pos.do_move(m, st[0]);
+        pos.do_move(r, st[1]);
+        split.counts[i] = perft(pos, depth - 2, table);
+        pos.undo_move(r);
+        pos.undo_move(m);
+
+        th->nodes.fetch_add(split.counts[i], std::memory_order_relaxed);
+    }
+  }
+
+  // perft_report() prints the leaf count below each root move, the total and
+  // the speed. Unsplit perfts are counted here.
+  void perft_report(Position& pos, Depth depth) {
+
+    const PerftSplit& split = Threads().perftSplit;
+    uint64_t nodes = 0;
+    size_t i = 0;
+    StateInfo st;
+    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
     for (const auto& m : MoveList<LEGAL>(pos))
     {
-        if (Root && depth <= 1)
-            cnt = 1, nodes++;
+        uint64_t cnt = 0;
+
+        if (depth >= 3)
+            for ( ; i < split.moves.size() && split.moves[i].first == m; ++i)
+                cnt += split.counts[i];
         else
         {
             pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
-            nodes += cnt;
+            cnt = perft(pos, depth - 1, Threads().perftTable);
             pos.undo_move(m);
         }
-        if (Root)
-            sync_cout << UCI::move(m, pos.is_chess960()) << ": " << cnt << sync_endl;
+
+        nodes += cnt;
+        sync_cout << UCI::move(m, pos.is_chess960()) << ": " << cnt << sync_endl;
     }
-    return nodes;
+
+    if (depth < 3)
+        Threads().main()->nodes = nodes;
+
+    TimePoint elapsed = now() - Limits().startTime + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    sync_cout << "\nNodes searched: " << nodes
+              << "\nNodes/second: " << 1000 * nodes / elapsed << "\n" << sync_endl;
   }
 
 } // namespace
@@ -160,12 +302,16 @@ void Search::init() {
 
 void Search::clear() {
 
-  Threads.main()->wait_for_search_finished();
+  Threads().main()->wait_for_search_finished();
+
+  Time().availableNodes = 0;
+  TT().clear();
+  Threads().clear();
 
-  Time.availableNodes = 0;
-  TT.clear();
-  Threads.clear();
-  Tablebases::init(Options["SyzygyPath"]); // Free mapped files
+  // The tablebase files are shared by all the engines of the process, so they
+  // can only be unmapped when no other engine may be probing them.
+  if (Engine::count() == 1)
+      Tablebases::init(Options()["SyzygyPath"]); // Free mapped files
 }
 
 
@@ -174,29 +320,36 @@ void Search::clear() {
 
 void MainThread::search() {
 
-  if (Limits.perft)
+  if (Limits().perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft);
-      sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+      Threads().perftTable.resize(size_t(Options()["Perft Hash"]));
+      perft_split(rootPos, Limits().perft);
+      Threads().start_searching(); // start non-main threads
+      Thread::search();            // main thread takes its share of the split
+      Threads().wait_for_search_finished();
+      perft_report(rootPos, Limits().perft);
       return;
   }
 
   Color us = rootPos.side_to_move();
-  Time.init(Limits, us, rootPos.game_ply());
-  TT.new_search();
+  Time().init(Limits(), us, rootPos.game_ply());
+  TT().new_search();
 
-  Eval::NNUE::verify();
+  Eval::NNUE::verify(!Engine::current().onInfo);
 
   if (rootMoves.empty())
   {
       rootMoves.emplace_back(MOVE_NONE);
-      sync_cout << "info depth 0 score "
-                << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
-                << sync_endl;
+      Value v = rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW;
+
+      if (Engine::current().onInfo)
+          Engine::current().onInfo({ { 0, 0, 1, v, BOUND_EXACT, 0, 0, 0, -1, Time().elapsed(), {} } });
+      else
+          sync_cout << "info depth 0 score " << UCI::value(v) << sync_endl;
   }
   else
   {
-      Threads.start_searching(); // start non-main threads
+      Threads().start_searching(); // start non-main threads
       Thread::search();          // main thread start searching
   }
 
@@ -206,41 +359,200 @@ void MainThread::search() {
   // GUI sends a "stop" or "ponderhit" command. We therefore simply wait here
   // until the GUI sends one of those commands.
 
-  while (!Threads.stop && (ponder || Limits.infinite))
+  while (!Threads().stop && (ponder || Limits().infinite))
   {} // Busy wait for a stop or a ponder reset
 
+  // With the MultiPV lines split, let the other groups also reach the depth
+  // limit, while still checking the time and node limits for them.
+  if (Limits().depth)
+      for (size_t g = 1; g < Threads().pvSplit.groups; ++g)
+          while (Threads()[g]->is_searching() && !Threads().stop)
+          {
+              callsCnt = 0;
+              check_time();
+              std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
+
+  Time().latency.search_ended();
+
   // Stop the threads if not already stopped (also raise the stop if
   // "ponderhit" just reset Threads.ponder).
-  Threads.stop = true;
+  Threads().stop = true;
 
   // Wait until all threads have finished
-  Threads.wait_for_search_finished();
+  Threads().wait_for_search_finished();
+
+  if (Limits().use_time_management())
+      Time().log_end(Threads().nodes_searched());
 
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
-  if (Limits.npmsec)
-      Time.availableNodes += Limits.inc[us] - Threads.nodes_searched();
+  if (Limits().npmsec)
+      Time().availableNodes += Limits().inc[us] - Threads().nodes_searched();
 
   Thread* bestThread = this;
 
-  if (   int(Options["MultiPV"]) == 1
-      && !Limits.depth
-      && !(Skill(Options["Skill Level"]).enabled() || int(Options["UCI_LimitStrength"]))
+  if (   int(Options()["MultiPV"]) == 1
+      && !Limits().depth
+      && !(Skill(Options()["Skill Level"]).enabled() || int(Options()["UCI_LimitStrength"]))
       && rootMoves[0].pv[0] != MOVE_NONE)
-      bestThread = Threads.get_best_thread();
+      bestThread = Threads().get_best_thread();
+
+  // With the MultiPV lines split, the best move is the best first line of the
+  // groups. Scores are only compared at the same depth, a deeper group wins.
+  auto firstScore = [](Thread* th) {
+      const RootMove& rm = th->rootMoves[0];
+      return rm.score != -VALUE_INFINITE ? rm.score : rm.previousScore;
+  };
+
+  for (size_t g = 1; g < Threads().pvSplit.groups; ++g)
+  {
+      Thread* th = Threads()[g];
+
+      if (   th->completedDepth > bestThread->completedDepth
+          || (   th->completedDepth == bestThread->completedDepth
+              && firstScore(th) > firstScore(bestThread)))
+          bestThread = th;
+  }
 
   bestPreviousScore = bestThread->rootMoves[0].score;
 
-  // Send again PV info if we have a new best thread
-  if (bestThread != this)
-      sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
+  // Keep the lines for the next search, see ThreadPool::reuse_last_search()
+  LastSearch& last = Threads().lastSearch;
+  size_t lines = std::min(size_t(Options()["MultiPV"]), bestThread->rootMoves.size());
+  last.fen = rootPos.fen();
+  last.chess960 = rootPos.is_chess960();
+  last.depth = bestThread->completedDepth;
+  last.lines.assign(bestThread->rootMoves.begin(), bestThread->rootMoves.begin() + lines);
+
+  for (RootMove& rm : last.lines)
+      if (rm.score == -VALUE_INFINITE)
+          rm.score = rm.previousScore;
+
+  // Send again PV info if we have a new best thread, or in the deterministic
+  // mode with the final node count, which only depends on the search then.
+  if (bestThread != this || Threads().deterministic)
+      report_pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE);
+
+  Move bestMove = bestThread->rootMoves[0].pv[0];
+  Move ponderMove =   bestThread->rootMoves[0].pv.size() > 1
+                   || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos) ? bestThread->rootMoves[0].pv[1]
+                                                                               : MOVE_NONE;
+
+  if (Engine::current().onBestMove)
+      Engine::current().onBestMove(bestMove, ponderMove);
+  else
+  {
+      sync_cout << "bestmove " << UCI::move(bestMove, rootPos.is_chess960());
+
+      if (ponderMove != MOVE_NONE)
+          std::cout << " ponder " << UCI::move(ponderMove, rootPos.is_chess960());
+
+      std::cout << sync_endl;
+  }
+
+  // Only the moves under time control are on a clock
+  if (Limits().use_time_management())
+      Time().latency.bestmove_sent();
 
-  sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
+  if (Options()["Search Stats"])
+  {
+      for (Thread* th : Threads())
+          sync_cout << "info string stats thread " << th->id() << " " << th->stats << sync_endl;
+
+      sync_cout << "info string stats total " << Threads().search_stats() << sync_endl;
+  }
+}
+
+
+/// Thread::analyze() is started when the program receives the 'analyze'
+/// command. Each thread repeatedly takes the next position of the batch,
+/// searches it alone up to the batch limit and prints the result as a single
+/// JSON line. The main thread also starts the other threads and, once they
+/// have all run out of positions, prints a summary of the batch.
+
+void Thread::analyze() {
+
+  AnalysisQueue& queue = *Threads().analysis;
+  size_t posIdx;
+
+  if (this == Threads().main())
+  {
+      Eval::NNUE::verify();
+      Threads().start_searching(); // start non-main threads
+  }
 
-  if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
-      std::cout << " ponder " << UCI::move(bestThread->rootMoves[0].pv[1], rootPos.is_chess960());
+  while (!Threads().stop && (posIdx = queue.next++) < queue.fens.size())
+  {
+      TimePoint startTime = now();
+
+      rootPos.set(queue.fens[posIdx], queue.chess960, &rootState, this);
+      rootMoves.clear();
+      for (const auto& m : MoveList<LEGAL>(rootPos))
+          rootMoves.emplace_back(m);
+
+      nodes = tbHits = nmpMinPly = bestMoveChanges = 0;
+      rootDepth = completedDepth = selDepth = 0;
+      stopBatch = false;
+
+      Value v;
+      if (rootMoves.empty())
+          v = rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW;
+      else
+      {
+          Thread::search();
+          v = rootMoves[0].score != -VALUE_INFINITE ? rootMoves[0].score : rootMoves[0].previousScore;
+      }
+
+      // UCI::value() gives either "cp <x>" or "mate <y>"
+      std::string scoreType;
+      int scoreValue;
+      std::istringstream is(UCI::value(v));
+      is >> scoreType >> scoreValue;
+
+      std::stringstream ss;
+      ss << "{\"index\":"    << posIdx
+         << ",\"fen\":\""     << rootPos.fen() << "\""
+         << ",\"depth\":"    << completedDepth
+         << ",\"seldepth\":" << selDepth
+         << ",\"nodes\":"    << nodes
+         << ",\"time\":"     << now() - startTime
+         << ",\"score\":{\"" << scoreType << "\":" << scoreValue << "}"
+         << ",\"bestmove\":";
+
+      if (rootMoves.empty())
+          ss << "null,\"pv\":[]}";
+      else
+      {
+          ss << "\"" << UCI::move(rootMoves[0].pv[0], queue.chess960) << "\",\"pv\":[";
+          for (size_t i = 0; i < rootMoves[0].pv.size(); ++i)
+              ss << (i ? ",\"" : "\"") << UCI::move(rootMoves[0].pv[i], queue.chess960) << "\"";
+          ss << "]}";
+      }
 
-  std::cout << sync_endl;
+      sync_cout << ss.str() << sync_endl;
+
+      queue.nodes += nodes;
+      queue.done++;
+  }
+
+  stopBatch = false;
+
+  if (this != Threads().main())
+      return;
+
+  Threads().wait_for_search_finished();
+
+  TimePoint elapsed = now() - queue.startTime + 1;
+  uint64_t batchNodes = queue.nodes;
+
+  sync_cout << "info string analyzed " << queue.done << " of " << queue.fens.size()
+            << " positions nodes " << batchNodes
+            << " time " << elapsed
+            << " nps " << batchNodes * 1000 / elapsed << sync_endl;
+
+  delete Threads().analysis;
+  Threads().analysis = nullptr;
 }
 
 
@@ -250,6 +562,12 @@ void MainThread::search() {
 
 void Thread::search() {
 
+  if (Limits().perft)
+  {
+      perft_worker(this, Limits().perft);
+      return;
+  }
+
   // To allow access to (ss-7) up to (ss+2), the stack must be oversized.
   // The former is needed to allow update_continuation_histories(ss-1, ...),
   // which accesses its argument at ss-6, also near the root.
@@ -259,7 +577,7 @@ void Thread::search() {
   Value bestValue, alpha, beta, delta;
   Move  lastBestMove = MOVE_NONE;
   Depth lastBestMoveDepth = 0;
-  MainThread* mainThread = (this == Threads.main() ? Threads.main() : nullptr);
+  MainThread* mainThread = (this == Threads().main() && !Threads().analysis ? Threads().main() : nullptr);
   double timeReduction = 1, totBestMoveChanges = 0;
   Color us = rootPos.side_to_move();
   int iterIdx = 0;
@@ -289,7 +607,7 @@ void Thread::search() {
   std::copy(&lowPlyHistory[2][0], &lowPlyHistory.back().back() + 1, &lowPlyHistory[0][0]);
   std::fill(&lowPlyHistory[MAX_LPH - 2][0], &lowPlyHistory.back().back() + 1, 0);
 
-  size_t multiPV = size_t(Options["MultiPV"]);
+  size_t multiPV = size_t(Options()["MultiPV"]);
 
   // Pick integer skill levels, but non-deterministically round up or down
   // such that the average integer skill corresponds to the input floating point one.
@@ -297,9 +615,9 @@ void Thread::search() {
   // to CCRL Elo (goldfish 1.13 = 2000) and a fit through Ordo derived Elo
   // for match (TC 60+0.6) results spanning a wide range of k values.
   PRNG rng(now());
-  double floatLevel = Options["UCI_LimitStrength"] ?
-                      std::clamp(std::pow((Options["UCI_Elo"] - 1346.6) / 143.4, 1 / 0.806), 0.0, 20.0) :
-                        double(Options["Skill Level"]);
+  double floatLevel = Options()["UCI_LimitStrength"] ?
+                      std::clamp(std::pow((Options()["UCI_Elo"] - 1346.6) / 143.4, 1 / 0.806), 0.0, 20.0) :
+                        double(Options()["Skill Level"]);
   int intLevel = int(floatLevel) +
                  ((floatLevel - int(floatLevel)) * 1024 > rng.rand<unsigned>() % 1024  ? 1 : 0);
   Skill skill(intLevel);
@@ -318,8 +636,10 @@ void Thread::search() {
 
   // Iterative deepening loop until requested to stop or the target depth is reached
   while (   ++rootDepth < MAX_PLY
-         && !Threads.stop
-         && !(Limits.depth && mainThread && rootDepth > Limits.depth))
+         && !stopped(this)
+         && !(   Limits().depth
+              && (mainThread || Threads().analysis || idx < Threads().pvSplit.groups)
+              && rootDepth > Limits().depth))
   {
       // Age out PV variability metric
       if (mainThread)
@@ -333,11 +653,11 @@ void Thread::search() {
       size_t pvFirst = 0;
       pvLast = 0;
 
-      if (!Threads.increaseDepth)
+      if (!Threads().increaseDepth)
          searchAgainCounter++;
 
       // MultiPV loop. We perform a full root search for each PV line
-      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+      for (pvIdx = 0; pvIdx < multiPV && !stopped(this); ++pvIdx)
       {
           if (pvIdx == pvLast)
           {
@@ -385,7 +705,7 @@ void Thread::search() {
               // If search has been stopped, we break immediately. Sorting is
               // safe because RootMoves is still valid, although it refers to
               // the previous iteration.
-              if (Threads.stop)
+              if (stopped(this))
                   break;
 
               // When failing high/low give some update (without cluttering
@@ -393,8 +713,8 @@ void Thread::search() {
               if (   mainThread
                   && multiPV == 1
                   && (bestValue <= alpha || bestValue >= beta)
-                  && Time.elapsed() > 3000)
-                  sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
+                  && Time().elapsed() > 3000)
+                  report_pv(rootPos, rootDepth, alpha, beta);
 
               // In case of failing low/high increase aspiration window and
               // re-search, otherwise exit the loop.
@@ -424,23 +744,32 @@ void Thread::search() {
           std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
 
           if (    mainThread
-              && (Threads.stop || pvIdx + 1 == multiPV || Time.elapsed() > 3000))
-              sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
+              && (Threads().stop || pvIdx + 1 == multiPV || Time().elapsed() > 3000))
+              report_pv(rootPos, rootDepth, alpha, beta);
       }
 
-      if (!Threads.stop)
+      if (!stopped(this))
           completedDepth = rootDepth;
 
+      // Publish the lines of the group for the main thread, see Search::info_lines()
+      if (!stopped(this) && idx < Threads().pvSplit.groups)
+      {
+          PVSplit& split = Threads().pvSplit;
+          std::lock_guard<std::mutex> lock(split.mutex);
+          split.lines[idx].assign(rootMoves.begin(), rootMoves.begin() + multiPV);
+          split.depths[idx] = completedDepth;
+      }
+
       if (rootMoves[0].pv[0] != lastBestMove) {
          lastBestMove = rootMoves[0].pv[0];
          lastBestMoveDepth = rootDepth;
       }
 
       // Have we found a "mate in x"?
-      if (   Limits.mate
+      if (   Limits().mate
           && bestValue >= VALUE_MATE_IN_MAX_PLY
-          && VALUE_MATE - bestValue <= 2 * Limits.mate)
-          Threads.stop = true;
+          && VALUE_MATE - bestValue <= 2 * Limits().mate)
+          Threads().stop = true;
 
       if (!mainThread)
           continue;
@@ -450,8 +779,8 @@ void Thread::search() {
           skill.pick_best(multiPV);
 
       // Do we have time for the next iteration? Can we stop searching now?
-      if (    Limits.use_time_management()
-          && !Threads.stop
+      if (    Limits().use_time_management()
+          && !Threads().stop
           && !mainThread->stopOnPonderhit)
       {
           double fallingEval = (318 + 6 * (mainThread->bestPreviousScore - bestValue)
@@ -463,42 +792,55 @@ void Thread::search() {
           double reduction = (1.47 + mainThread->previousTimeReduction) / (2.32 * timeReduction);
 
           // Use part of the gained time from a previous stable move for the current move
-          for (Thread* th : Threads)
+          for (Thread* th : Threads())
           {
               totBestMoveChanges += th->bestMoveChanges;
               th->bestMoveChanges = 0;
           }
           double bestMoveInstability = 1.073 + std::max(1.0, 2.25 - 9.9 / rootDepth)
-                                              * totBestMoveChanges / Threads.size();
-          double totalTime = Time.optimum() * fallingEval * reduction * bestMoveInstability;
+                                              * totBestMoveChanges / Threads().size();
+          double totalTime = Time().optimum() * fallingEval * reduction * bestMoveInstability;
+          TimePoint nextIteration = Time().predict_iteration(completedDepth, Threads().nodes_searched());
 
           // Cap used time in case of a single legal move for a better viewer experience in tournaments
           // yielding correct scores and sufficiently fast moves.
           if (rootMoves.size() == 1)
               totalTime = std::min(500.0, totalTime);
 
-          // Stop the search if we have exceeded the totalTime
-          if (Time.elapsed() > totalTime)
+          // Stop the search if we have exceeded the totalTime, or if the next
+          // iteration would be aborted at the maximum time anyway.
+          if (   Time().elapsed() > totalTime
+              || !Time().next_iteration_fits(nextIteration))
           {
               // If we are allowed to ponder do not stop the search now but
               // keep pondering until the GUI sends "ponderhit" or "stop".
               if (mainThread->ponder)
                   mainThread->stopOnPonderhit = true;
               else
-                  Threads.stop = true;
+                  Threads().stop = true;
           }
-          else if (   Threads.increaseDepth
+          else if (   Threads().increaseDepth
                    && !mainThread->ponder
-                   && Time.elapsed() > totalTime * 0.58)
-                   Threads.increaseDepth = false;
+                   && Time().elapsed() > totalTime * 0.58)
+                   Threads().increaseDepth = false;
           else
-                   Threads.increaseDepth = true;
+                   Threads().increaseDepth = true;
       }
 
       mainThread->iterValue[iterIdx] = bestValue;
       iterIdx = (iterIdx + 1) & 3;
   }
 
+  // In the deterministic mode the other threads can only stop at the end of a
+  // quantum, so take part in the barrier until the stop is raised there.
+  while (Threads().deterministic && !Threads().quantum.stop)
+  {
+      if (mainThread && !mainThread->ponder && !Limits().infinite)
+          Threads().stop = true;
+
+      end_quantum();
+  }
+
   if (!mainThread)
       return;
 
@@ -543,7 +885,7 @@ namespace {
     assert(0 < depth && depth < MAX_PLY);
     assert(!(PvNode && cutNode));
 
-    Move pv[MAX_PLY+1], capturesSearched[32], quietsSearched[64];
+    Move pv[MAX_PLY+1], capturesSearched[32], quietsSearched[64], deferred[MaxDeferred];
     StateInfo st;
     ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
@@ -556,29 +898,42 @@ namespace {
     bool captureOrPromotion, doFullDepthSearch, moveCountPruning,
          ttCapture, singularQuietLMR;
     Piece movedPiece;
-    int moveCount, captureCount, quietCount;
+    int moveCount, captureCount, quietCount, deferredCount, deferredIdx;
 
     // Step 1. Initialize node
     Thread* thisThread = pos.this_thread();
+    if constexpr (SearchStatsEnabled)
+        thisThread->stats.searchNodes++;
     ss->inCheck        = pos.checkers();
     priorCapture       = pos.captured_piece();
     Color us           = pos.side_to_move();
     moveCount          = captureCount = quietCount = ss->moveCount = 0;
+    deferredCount      = deferredIdx = 0;
     bestValue          = -VALUE_INFINITE;
     maxValue           = VALUE_INFINITE;
 
-    // Check for the available remaining time
-    if (thisThread == Threads.main())
+    // Check for the available remaining time, or for the node limit of the
+    // position when analyzing a batch.
+    if (thisThread->threads().analysis)
+        thisThread->stopBatch |=  Limits().nodes
+                               && thisThread->completedDepth
+                               && thisThread->nodes.load(std::memory_order_relaxed) >= uint64_t(Limits().nodes);
+    else if (thisThread == thisThread->threads().main())
         static_cast<MainThread*>(thisThread)->check_time();
 
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
     if (PvNode && thisThread->selDepth < ss->ply + 1)
         thisThread->selDepth = ss->ply + 1;
 
+    // Wait for the other threads at the end of the quantum in the deterministic mode
+    if (   thisThread->threads().deterministic
+        && thisThread->nodes.load(std::memory_order_relaxed) >= thisThread->nextQuantum)
+        thisThread->end_quantum();
+
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
-        if (   Threads.stop.load(std::memory_order_relaxed)
+        if (   stopped(thisThread)
             || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
             return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos)
@@ -598,6 +953,10 @@ namespace {
 
     assert(0 <= ss->ply && ss->ply < MAX_PLY);
 
+    // Tell the other threads that this node is being searched, in the 'abdada' SMP mode
+    NodeMarker marker(thisThread, pos.key(),
+                      !PvNode && depth >= MarkDepth && !ss->excludedMove && thisThread->threads().abdada);
+
     (ss+1)->ttPv         = false;
     (ss+1)->excludedMove = bestMove = MOVE_NONE;
     (ss+2)->killers[0]   = (ss+2)->killers[1] = MOVE_NONE;
@@ -617,12 +976,19 @@ namespace {
     // position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = excludedMove == MOVE_NONE ? pos.key() : pos.key() ^ make_key(excludedMove);
-    tte = TT.probe(posKey, ss->ttHit);
-    ttValue = ss->ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
+    tte = thisThread->ttLog.enabled() ? thisThread->ttLog.probe(posKey, ss->ttHit)
+                                      : thisThread->tt().probe(posKey, ss->ttHit);
+    TTData ttData = *tte;
+    ss->ttHit = ss->ttHit && ttData.matches(posKey);
+    ttValue = ss->ttHit ? value_from_tt(ttData.value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
-            : ss->ttHit    ? tte->move() : MOVE_NONE;
+            : ss->ttHit    ? ttData.move() : MOVE_NONE;
+
+    // A tt move which is not even pseudo legal reveals a false match of the key
+    if (TTStatsEnabled && ss->ttHit && !rootNode && ttMove && !pos.pseudo_legal(ttMove))
+        thisThread->ttStats.falseMatches++;
     if (!excludedMove)
-        ss->ttPv = PvNode || (ss->ttHit && tte->is_pv());
+        ss->ttPv = PvNode || (ss->ttHit && ttData.is_pv());
 
     // Update low ply history for previous move if we are near root and position is or has been in PV
     if (   ss->ttPv
@@ -639,10 +1005,10 @@ namespace {
     // At non-PV nodes we check for an early TT cutoff
     if (  !PvNode
         && ss->ttHit
-        && tte->depth() >= depth
+        && ttData.depth() >= depth
         && ttValue != VALUE_NONE // Possible in case of TT access race
-        && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
-                            : (tte->bound() & BOUND_UPPER)))
+        && (ttValue >= beta ? (ttData.bound() & BOUND_LOWER)
+                            : (ttData.bound() & BOUND_UPPER)))
     {
         // If ttMove is quiet, update move sorting heuristics on TT hit
         if (ttMove)
@@ -686,7 +1052,7 @@ namespace {
             TB::WDLScore wdl = Tablebases::probe_wdl(pos, &err);
 
             // Force check of time on the next occasion
-            if (thisThread == Threads.main())
+            if (thisThread == thisThread->threads().main())
                 static_cast<MainThread*>(thisThread)->callsCnt = 0;
 
             if (err != TB::ProbeState::FAIL)
@@ -737,7 +1103,7 @@ namespace {
     else if (ss->ttHit)
     {
         // Never assume anything about values stored in TT
-        ss->staticEval = eval = tte->eval();
+        ss->staticEval = eval = ttData.eval();
         if (eval == VALUE_NONE)
             ss->staticEval = eval = evaluate(pos);
 
@@ -747,7 +1113,7 @@ namespace {
 
         // Can ttValue be used as a better position evaluation?
         if (    ttValue != VALUE_NONE
-            && (tte->bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER)))
+            && (ttData.bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER)))
             eval = ttValue;
     }
     else
@@ -804,6 +1170,8 @@ namespace {
         ss->currentMove = MOVE_NULL;
         ss->continuationHistory = &thisThread->continuationHistory[0][0][NO_PIECE][0];
 
+        if constexpr (SearchStatsEnabled)
+            thisThread->stats.nullMoveTries++;
         pos.do_null_move(st);
 
         Value nullValue = -search<NonPV>(pos, ss+1, -beta, -beta+1, depth-R, !cutNode);
@@ -817,7 +1185,11 @@ namespace {
                 nullValue = beta;
 
             if (thisThread->nmpMinPly || (abs(beta) < VALUE_KNOWN_WIN && depth < 14))
+            {
+                if constexpr (SearchStatsEnabled)
+                    thisThread->stats.nullMoveCutoffs++;
                 return nullValue;
+            }
 
             assert(!thisThread->nmpMinPly); // Recursive verification is not allowed
 
@@ -831,7 +1203,11 @@ namespace {
             thisThread->nmpMinPly = 0;
 
             if (v >= beta)
+            {
+                if constexpr (SearchStatsEnabled)
+                    thisThread->stats.nullMoveCutoffs++;
                 return nullValue;
+            }
         }
     }
 
@@ -848,7 +1224,7 @@ namespace {
         // because probCut search has depth set to depth - 4 but we also do a move before it
         // so effective depth is equal to depth - 3
         && !(   ss->ttHit
-             && tte->depth() >= depth - 3
+             && ttData.depth() >= depth - 3
              && ttValue != VALUE_NONE
              && ttValue < probCutBeta))
     {
@@ -890,11 +1266,13 @@ namespace {
                 {
                     // if transposition table doesn't have equal or more deep info write probCut data into it
                     if ( !(ss->ttHit
-                       && tte->depth() >= depth - 3
+                       && ttData.depth() >= depth - 3
                        && ttValue != VALUE_NONE))
                         tte->save(posKey, value_to_tt(value, ss->ply), ttPv,
                             BOUND_LOWER,
                             depth - 3, move, ss->staticEval);
+                    if constexpr (SearchStatsEnabled)
+                        thisThread->stats.probCutCutoffs++;
                     return value;
                 }
             }
@@ -917,13 +1295,17 @@ moves_loop: // When in check, search starts from here
         && !PvNode
         && depth >= 4
         && ttCapture
-        && (tte->bound() & BOUND_LOWER)
-        && tte->depth() >= depth - 3
+        && (ttData.bound() & BOUND_LOWER)
+        && ttData.depth() >= depth - 3
         && ttValue >= probCutBeta
         && abs(ttValue) <= VALUE_KNOWN_WIN
         && abs(beta) <= VALUE_KNOWN_WIN
        )
+    {
+        if constexpr (SearchStatsEnabled)
+            thisThread->stats.probCutCutoffs++;
         return probCutBeta;
+    }
 
 
     const PieceToHistory* contHist[] = { (ss-1)->continuationHistory, (ss-2)->continuationHistory,
@@ -948,12 +1330,13 @@ moves_loop: // When in check, search starts from here
     // at a depth equal or greater than the current depth, and the result of this search was a fail low.
     bool likelyFailLow =    PvNode
                          && ttMove
-                         && (tte->bound() & BOUND_UPPER)
-                         && tte->depth() >= depth;
+                         && (ttData.bound() & BOUND_UPPER)
+                         && ttData.depth() >= depth;
 
     // Step 12. Loop through all pseudo-legal moves until no moves remain
-    // or a beta cutoff occurs.
-    while ((move = mp.next_move(moveCountPruning)) != MOVE_NONE)
+    // or a beta cutoff occurs, then through the deferred moves if any.
+    while (   (move = mp.next_move(moveCountPruning)) != MOVE_NONE
+           || (deferredIdx < deferredCount && (move = deferred[deferredIdx++]) != MOVE_NONE))
     {
       assert(is_ok(move));
 
@@ -972,9 +1355,28 @@ moves_loop: // When in check, search starts from here
       if (!rootNode && !pos.legal(move))
           continue;
 
+      // In the 'abdada' SMP mode, postpone a move leading to a node that another
+      // thread is searching, as its result may be in the TT once we come back to it.
+      if (   !PvNode
+          && moveCount
+          && !deferredIdx
+          && deferredCount < MaxDeferred
+          && depth >= DeferDepth
+          && thisThread->threads().abdada
+          && marked_by_other(thisThread, pos.key_after(move)))
+      {
+          deferred[deferredCount++] = move;
+          continue;
+      }
+
       ss->moveCount = ++moveCount;
 
-      if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
+      if (   rootNode
+          && thisThread == thisThread->threads().main()
+          && !thisThread->threads().analysis
+          && !Engine::current().onInfo
+          && !thisThread->threads().pvSplit.groups
+          && Time().elapsed() > 3000)
           sync_cout << "info depth " << depth
                     << " currmove " << UCI::move(move, pos.is_chess960())
                     << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
@@ -1050,8 +1452,8 @@ moves_loop: // When in check, search starts from here
           && !excludedMove // Avoid recursive singular search
        /* &&  ttValue != VALUE_NONE Already implicit in the next condition */
           &&  abs(ttValue) < VALUE_KNOWN_WIN
-          && (tte->bound() & BOUND_LOWER)
-          &&  tte->depth() >= depth - 3)
+          && (ttData.bound() & BOUND_LOWER)
+          &&  ttData.depth() >= depth - 3)
       {
           Value singularBeta = ttValue - 2 * depth;
           Depth singularDepth = (depth - 1) / 2;
@@ -1062,6 +1464,8 @@ moves_loop: // When in check, search starts from here
 
           if (value < singularBeta)
           {
+              if constexpr (SearchStatsEnabled)
+                  thisThread->stats.singularExtensions++;
               extension = 1;
               singularQuietLMR = !ttCapture;
 
@@ -1105,7 +1509,7 @@ moves_loop: // When in check, search starts from here
       ss->doubleExtensions = (ss-1)->doubleExtensions + (extension == 2);
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(thisThread->tt().first_entry(pos.key_after(move)));
 
       // Update the current move (this must be done after singular extension search)
       ss->currentMove = move;
@@ -1187,6 +1591,8 @@ moves_loop: // When in check, search starts from here
           // If the son is reduced and fails high it will be re-searched at full depth
           doFullDepthSearch = value > alpha && d < newDepth;
           didLMR = true;
+          if constexpr (SearchStatsEnabled)
+              thisThread->stats.lmrResearches += doFullDepthSearch;
       }
       else
       {
@@ -1230,7 +1636,7 @@ moves_loop: // When in check, search starts from here
       // Finished searching the move. If a stop occurred, the return value of
       // the search cannot be trusted, and we return immediately without
       // updating best move, PV and TT.
-      if (Threads.stop.load(std::memory_order_relaxed))
+      if (stopped(thisThread))
           return VALUE_ZERO;
 
       if (rootNode)
@@ -1298,7 +1704,7 @@ moves_loop: // When in check, search starts from here
     // completed. But in this case bestValue is valid because we have fully
     // searched our subtree, and we can anyhow save the result in TT.
     /*
-       if (Threads.stop)
+       if (thisThread->threads().stop)
         return VALUE_DRAW;
     */
 
@@ -1381,6 +1787,8 @@ moves_loop: // When in check, search starts from here
     }
 
     Thread* thisThread = pos.this_thread();
+    if constexpr (SearchStatsEnabled)
+        thisThread->stats.qsearchNodes++;
     bestMove = MOVE_NONE;
     ss->inCheck = pos.checkers();
     moveCount = 0;
@@ -1397,19 +1805,26 @@ moves_loop: // When in check, search starts from here
     // only two types of depth in TT: DEPTH_QS_CHECKS or DEPTH_QS_NO_CHECKS.
     ttDepth = ss->inCheck || depth >= DEPTH_QS_CHECKS ? DEPTH_QS_CHECKS
                                                   : DEPTH_QS_NO_CHECKS;
-    // Transposition table lookup
+    // Transposition table lookup, through the qsearch table of the thread if any
     posKey = pos.key();
-    tte = TT.probe(posKey, ss->ttHit);
-    ttValue = ss->ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
-    ttMove = ss->ttHit ? tte->move() : MOVE_NONE;
-    pvHit = ss->ttHit && tte->is_pv();
+    tte = thisThread->ttLog.enabled()   ? thisThread->ttLog.probe(posKey, ss->ttHit)
+        : thisThread->qsTable.enabled() ? thisThread->qsTable.probe(posKey, ss->ttHit)
+                                        : thisThread->tt().probe(posKey, ss->ttHit);
+    TTData ttData = *tte;
+    ss->ttHit = ss->ttHit && ttData.matches(posKey);
+    ttValue = ss->ttHit ? value_from_tt(ttData.value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
+    ttMove = ss->ttHit ? ttData.move() : MOVE_NONE;
+    pvHit = ss->ttHit && ttData.is_pv();
+
+    if (TTStatsEnabled && ttMove && !pos.pseudo_legal(ttMove))
+        thisThread->ttStats.falseMatches++;
 
     if (  !PvNode
         && ss->ttHit
-        && tte->depth() >= ttDepth
+        && ttData.depth() >= ttDepth
         && ttValue != VALUE_NONE // Only in case of TT access race
-        && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
-                            : (tte->bound() & BOUND_UPPER)))
+        && (ttValue >= beta ? (ttData.bound() & BOUND_LOWER)
+                            : (ttData.bound() & BOUND_UPPER)))
         return ttValue;
 
     // Evaluate the position statically
@@ -1423,12 +1838,12 @@ moves_loop: // When in check, search starts from here
         if (ss->ttHit)
         {
             // Never assume anything about values stored in TT
-            if ((ss->staticEval = bestValue = tte->eval()) == VALUE_NONE)
+            if ((ss->staticEval = bestValue = ttData.eval()) == VALUE_NONE)
                 ss->staticEval = bestValue = evaluate(pos);
 
             // Can ttValue be used as a better position evaluation?
             if (    ttValue != VALUE_NONE
-                && (tte->bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER)))
+                && (ttData.bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER)))
                 bestValue = ttValue;
         }
         else
@@ -1466,7 +1881,8 @@ moves_loop: // When in check, search starts from here
     MovePicker mp(pos, ttMove, depth, &thisThread->mainHistory,
                                       &thisThread->captureHistory,
                                       contHist,
-                                      to_sq((ss-1)->currentMove));
+                                      to_sq((ss-1)->currentMove),
+                                      thisThread->threads().qsPrefetch ? &thisThread->qsTable : nullptr);
 
     // Loop through the moves until no moves remain or a beta cutoff occurs
     while ((move = mp.next_move()) != MOVE_NONE)
@@ -1509,7 +1925,7 @@ moves_loop: // When in check, search starts from here
           continue;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      thisThread->qsTable.prefetch(pos.key_after(move));
 
       // Check for legality just before making the move
       if (!pos.legal(move))
@@ -1734,7 +2150,7 @@ moves_loop: // When in check, search starts from here
 
   Move Skill::pick_best(size_t multiPV) {
 
-    const RootMoves& rootMoves = Threads.main()->rootMoves;
+    const RootMoves& rootMoves = Threads().main()->rootMoves;
     static PRNG rng(now()); // PRNG sequence should be non-deterministic
 
     // RootMoves are already sorted by score in descending order
@@ -1774,12 +2190,12 @@ void MainThread::check_time() {
       return;
 
   // When using nodes, ensure checking rate is not lower than 0.1% of nodes
-  callsCnt = Limits.nodes ? std::min(1024, int(Limits.nodes / 1024)) : 1024;
+  callsCnt = Limits().nodes ? std::min(1024, int(Limits().nodes / 1024)) : 1024;
 
   static TimePoint lastInfoTime = now();
 
-  TimePoint elapsed = Time.elapsed();
-  TimePoint tick = Limits.startTime + elapsed;
+  TimePoint elapsed = Time().elapsed();
+  TimePoint tick = Limits().startTime + elapsed;
 
   if (tick - lastInfoTime >= 1000)
   {
@@ -1791,25 +2207,27 @@ void MainThread::check_time() {
   if (ponder)
       return;
 
-  if (   (Limits.use_time_management() && (elapsed > Time.maximum() - 10 || stopOnPonderhit))
-      || (Limits.movetime && elapsed >= Limits.movetime)
-      || (Limits.nodes && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
-      Threads.stop = true;
+  if (   (Limits().use_time_management() && (elapsed > Time().maximum() - 10 || stopOnPonderhit))
+      || (Limits().movetime && elapsed >= Limits().movetime)
+      || (Limits().nodes && !Threads().deterministic && Threads().nodes_searched() >= (uint64_t)Limits().nodes))
+      Threads().stop = true;
 }
 
 
-/// UCI::pv() formats PV information according to the UCI protocol. UCI requires
-/// that all (if any) unsearched PV lines are sent using a previous search score.
+/// Search::info_lines() collects the PV information of all the MultiPV lines
+/// searched so far. UCI requires that all (if any) unsearched PV lines are
+/// sent using a previous search score.
 
-string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
+std::vector<InfoLine> Search::info_lines(const Position& pos, Depth depth, Value alpha, Value beta) {
 
-  std::stringstream ss;
-  TimePoint elapsed = Time.elapsed() + 1;
+  std::vector<InfoLine> lines;
+  TimePoint elapsed = Time().elapsed() + 1;
   const RootMoves& rootMoves = pos.this_thread()->rootMoves;
   size_t pvIdx = pos.this_thread()->pvIdx;
-  size_t multiPV = std::min((size_t)Options["MultiPV"], rootMoves.size());
-  uint64_t nodesSearched = Threads.nodes_searched();
-  uint64_t tbHits = Threads.tb_hits() + (TB::RootInTB ? rootMoves.size() : 0);
+  size_t multiPV = std::min((size_t)Options()["MultiPV"], rootMoves.size());
+  uint64_t nodesSearched = Threads().nodes_searched();
+  uint64_t tbHits = Threads().tb_hits() + (TB::RootInTB ? rootMoves.size() : 0);
+  int hashfull = elapsed > 1000 ? TT().hashfull() : -1; // Earlier makes little sense
 
   for (size_t i = 0; i < multiPV; ++i)
   {
@@ -1827,32 +2245,82 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
       bool tb = TB::RootInTB && abs(v) < VALUE_MATE_IN_MAX_PLY;
       v = tb ? rootMoves[i].tbScore : v;
 
+      Bound bound =  tb || i != pvIdx ? BOUND_EXACT
+                   : v >= beta        ? BOUND_LOWER
+                   : v <= alpha       ? BOUND_UPPER : BOUND_EXACT;
+
+      lines.push_back({ d, rootMoves[i].selDepth, i + 1, v, bound,
+                        nodesSearched, nodesSearched * 1000 / elapsed, tbHits,
+                        hashfull, elapsed, rootMoves[i].pv });
+  }
+
+  // With the MultiPV lines split, add the lines of the last iteration completed
+  // by the other groups of threads, and keep the best ones.
+  PVSplit& split = Threads().pvSplit;
+
+  if (split.groups)
+  {
+      std::lock_guard<std::mutex> lock(split.mutex);
+
+      // Skip the group of this thread, whose lines are already in rootMoves
+      for (size_t g = 0; g < split.groups; ++g)
+          if (g != pos.this_thread()->id() % split.groups)
+              for (const RootMove& rm : split.lines[g])
+                  if (rm.score != -VALUE_INFINITE)
+                  {
+                      bool tb = TB::RootInTB && abs(rm.score) < VALUE_MATE_IN_MAX_PLY;
+
+                      lines.push_back({ split.depths[g], rm.selDepth, 0, tb ? rm.tbScore : rm.score,
+                                        BOUND_EXACT, nodesSearched, nodesSearched * 1000 / elapsed,
+                                        tbHits, hashfull, elapsed, rm.pv });
+                  }
+
+      std::stable_sort(lines.begin(), lines.end(), [](const InfoLine& a, const InfoLine& b) {
+                           return a.score > b.score; });
+
+      lines.resize(std::min(lines.size(), size_t(Options()["MultiPV"])));
+
+      for (size_t i = 0; i < lines.size(); ++i)
+          lines[i].multiPV = i + 1;
+  }
+
+  return lines;
+}
+
+
+/// UCI::pv() formats PV information according to the UCI protocol
+
+string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
+
+  std::stringstream ss;
+
+  for (const InfoLine& l : Search::info_lines(pos, depth, alpha, beta))
+  {
       if (ss.rdbuf()->in_avail()) // Not at first line
           ss << "\n";
 
       ss << "info"
-         << " depth "    << d
-         << " seldepth " << rootMoves[i].selDepth
-         << " multipv "  << i + 1
-         << " score "    << UCI::value(v);
+         << " depth "    << l.depth
+         << " seldepth " << l.selDepth
+         << " multipv "  << l.multiPV
+         << " score "    << UCI::value(l.score);
 
-      if (Options["UCI_ShowWDL"])
-          ss << UCI::wdl(v, pos.game_ply());
+      if (Options()["UCI_ShowWDL"])
+          ss << UCI::wdl(l.score, pos.game_ply());
 
-      if (!tb && i == pvIdx)
-          ss << (v >= beta ? " lowerbound" : v <= alpha ? " upperbound" : "");
+      ss << (l.bound == BOUND_LOWER ? " lowerbound" : l.bound == BOUND_UPPER ? " upperbound" : "");
 
-      ss << " nodes "    << nodesSearched
-         << " nps "      << nodesSearched * 1000 / elapsed;
+      ss << " nodes "    << l.nodes
+         << " nps "      << l.nps;
 
-      if (elapsed > 1000) // Earlier makes little sense
-          ss << " hashfull " << TT.hashfull();
+      if (l.hashfull >= 0)
+          ss << " hashfull " << l.hashfull;
 
-      ss << " tbhits "   << tbHits
-         << " time "     << elapsed
+      ss << " tbhits "   << l.tbHits
+         << " time "     << l.time
          << " pv";
 
-      for (Move m : rootMoves[i].pv)
+      for (Move m : l.pv)
           ss << " " << UCI::move(m, pos.is_chess960());
   }
 
@@ -1878,7 +2346,7 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
         return false;
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    TTEntry* tte = TT().probe(pos.key(), ttHit);
 
     if (ttHit)
     {
@@ -1891,13 +2359,15 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
     return pv.size() > 1;
 }
 
-void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
+/// Tablebases::set_probe_limits() reads the tablebase probing limits of the
+/// search from the UCI options, without ranking any root moves.
+
+void Tablebases::set_probe_limits() {
 
     RootInTB = false;
-    UseRule50 = bool(Options["Syzygy50MoveRule"]);
-    ProbeDepth = int(Options["SyzygyProbeDepth"]);
-    Cardinality = int(Options["SyzygyProbeLimit"]);
-    bool dtz_available = true;
+    UseRule50 = bool(Options()["Syzygy50MoveRule"]);
+    ProbeDepth = int(Options()["SyzygyProbeDepth"]);
+    Cardinality = int(Options()["SyzygyProbeLimit"]);
 
     // Tables with fewer pieces than SyzygyProbeLimit are searched with
     // ProbeDepth == DEPTH_ZERO
@@ -1906,6 +2376,12 @@ void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
         Cardinality = MaxCardinality;
         ProbeDepth = 0;
     }
+}
+
+void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
+
+    set_probe_limits();
+    bool dtz_available = true;
 
     if (Cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
     {
@@ -102,10 +102,25 @@ struct LimitsType {
   int64_t nodes;
 };
 
-extern LimitsType Limits;
+/// InfoLine struct keeps the data of one line of the 'info' output of the
+/// search, so that it can be either printed to the GUI or handed over to a
+/// caller of the library interface.
+
+struct InfoLine {
+  Depth depth;
+  int selDepth;
+  size_t multiPV;
+  Value score;
+  Bound bound;  // BOUND_LOWER or BOUND_UPPER after a fail high or low
+  uint64_t nodes, nps, tbHits;
+  int hashfull; // -1 when not computed, during the first second of the search
+  TimePoint time;
+  std::vector<Move> pv;
+};
 
 void init();
 void clear();
+std::vector<InfoLine> info_lines(const Position& pos, Depth depth, Value alpha, Value beta);
 
 } // namespace Search
 
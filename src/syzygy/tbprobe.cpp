@@ -29,6 +29,7 @@
 #include <mutex>
 
 #include "../bitboard.h"
+#include "../engine.h"
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
@@ -1522,7 +1523,7 @@ bool Tablebases::root_probe(Position& pos, Search::RootMoves& rootMoves) {
     // Check whether a position was repeated since the last zeroing move.
     bool rep = pos.has_repeated();
 
-    int dtz, bound = Options["Syzygy50MoveRule"] ? 900 : 1;
+    int dtz, bound = Options()["Syzygy50MoveRule"] ? 900 : 1;
 
     // Probe and rank each move
     for (auto& m : rootMoves)
@@ -1596,7 +1597,7 @@ bool Tablebases::root_probe_wdl(Position& pos, Search::RootMoves& rootMoves) {
     StateInfo st;
     WDLScore wdl;
 
-    bool rule50 = Options["Syzygy50MoveRule"];
+    bool rule50 = Options()["Syzygy50MoveRule"];
 
     // Probe and rank each move
     for (auto& m : rootMoves)
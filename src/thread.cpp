@@ -19,6 +19,8 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include <chrono>
+#include "engine.h"
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -28,13 +30,33 @@
 
 namespace Stockfish {
 
-ThreadPool Threads; // Global object
+namespace {
+
+  // spin() busy waits until the condition holds or the spin budget, set by the
+  // Thread Spin option in microseconds, is spent. It saves the latency of the
+  // wakeup of a thread parked on a condition variable when the wait is short.
+  template<typename Condition>
+  void spin(Condition done) {
+
+    const auto budget = std::chrono::microseconds(int(Options()["Thread Spin"]));
+
+    if (budget.count() == 0)
+        return;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    while (!done() && std::chrono::steady_clock::now() - start < budget)
+        std::this_thread::yield();
+  }
+
+} // namespace
 
 
 /// Thread constructor launches the thread and waits until it goes to sleep
 /// in idle_loop(). Note that 'searching' and 'exit' should be already set.
 
-Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
+Thread::Thread(size_t n) : idx(n), engine(&Engine::current()), pool(engine->threads), table(engine->tt),
+                           stdThread(&Thread::idle_loop, this), qsTable(engine->tt) {
 
   wait_for_search_finished();
 }
@@ -53,10 +75,16 @@ Thread::~Thread() {
 }
 
 
-/// Thread::clear() reset histories, usually before a new game
+/// Thread::clear() reset histories, hash statistics and the pawn, material and
+/// qsearch tables, usually before a new game. It is run by the thread itself,
+/// see ThreadPool::clear().
 
 void Thread::clear() {
 
+  ttStats = TTStats();
+  pawnsTable.clear();
+  materialTable.clear();
+  qsTable.resize(size_t(Options()["QSearch Hash"]));
   counterMoves.fill(MOVE_NONE);
   mainHistory.fill(0);
   lowPlyHistory.fill(0);
@@ -83,45 +111,119 @@ void Thread::start_searching() {
 }
 
 
+/// Thread::start_job() wakes up the thread to run the given job instead of a
+/// search. Wait for it with wait_for_search_finished().
+
+void Thread::start_job(std::function<void()> f) {
+
+  wait_for_search_finished();
+  job = std::move(f);
+  start_searching();
+}
+
+
 /// Thread::wait_for_search_finished() blocks on the condition variable
 /// until the thread has finished searching.
 
 void Thread::wait_for_search_finished() {
 
+  spin([&]{ return !searching; });
+
   std::unique_lock<std::mutex> lk(mutex);
   cv.wait(lk, [&]{ return !searching; });
 }
 
 
 /// Thread::idle_loop() is where the thread is parked, blocked on the
-/// condition variable, when it has no work to do.
+/// condition variable, when it has no search or job to do. With Thread Spin,
+/// the thread first spins for a while, so that a search started soon after is
+/// picked up at once.
 
 void Thread::idle_loop() {
 
+  // All the accesses of the thread to the engine state go to its own engine
+  Engine::Scope scope(*engine);
+
   // If OS already scheduled us on a different group than 0 then don't overwrite
   // the choice, eventually we are one of many one-threaded processes running on
   // some Windows NUMA hardware, for instance in fishtest. To make it simple,
   // just check if running threads are below a threshold, in this case all this
   // NUMA machinery is not needed.
-  if (Options["Threads"] > 8)
+  if (Options()["Threads"] > 8)
       WinProcGroup::bindThisThread(idx);
 
+  // On Linux, pin the thread to its NUMA node when a NUMA policy is requested,
+  // so that it runs next to its share of the hash table.
+  if (!(Options()["NUMA Policy"] == "none"))
+      Numa::bindThisThread(idx);
+
+  TTStats::bind(&ttStats);
+
   while (true)
   {
       std::unique_lock<std::mutex> lk(mutex);
       searching = false;
       cv.notify_one(); // Wake up anyone waiting for search finished
-      cv.wait(lk, [&]{ return searching; });
+
+      lk.unlock();
+      spin([&]{ return searching.load(); });
+      lk.lock();
+
+      cv.wait(lk, [&]{ return searching.load(); });
 
       if (exit)
           return;
 
       lk.unlock();
 
-      search();
+      if (job)
+      {
+          job();
+          job = nullptr;
+      }
+      else if (Threads().analysis)
+          analyze();
+      else
+          search();
+  }
+}
+
+/// Thread::end_quantum() is called by a thread of a deterministic search once it
+/// has searched its quantum of nodes, and waits until all the threads have done
+/// so. The last one to arrive flushes the TT logs of all threads in thread order,
+/// and raises the stop of the search if it was requested in the quantum or the
+/// node limit is reached. Once the search is stopped it returns immediately.
+
+void Thread::end_quantum() {
+
+  ThreadPool& threads = Threads();
+  QuantumSync& q = threads.quantum;
+  std::unique_lock<std::mutex> lk(q.mutex);
+
+  if (q.stop)
+      return;
+
+  const uint64_t round = q.round;
+
+  if (++q.arrived < threads.size())
+      q.cv.wait(lk, [&]{ return q.round != round; });
+  else
+  {
+      for (Thread* th : threads)
+          th->ttLog.flush();
+
+      q.stop =   threads.stop
+              || (   Search::Limits().nodes
+                  && threads.nodes_searched() >= uint64_t(Search::Limits().nodes));
+      q.arrived = 0;
+      q.round++;
+      q.cv.notify_all();
   }
+
+  nextQuantum += ThreadPool::QuantumNodes;
 }
 
+
 /// ThreadPool::set() creates/destroys threads to match the requested number.
 /// Created and launched threads will immediately go to sleep in idle_loop.
 /// Upon resizing, threads are recreated to allow for binding if necessary.
@@ -145,7 +247,7 @@ void ThreadPool::set(size_t requested) {
       clear();
 
       // Reallocate the hash with the new threadpool size
-      TT.resize(size_t(Options["Hash"]));
+      TT().resize(size_t(Options()["Hash"]));
 
       // Init thread number dependent search params.
       Search::init();
@@ -157,12 +259,71 @@ void ThreadPool::set(size_t requested) {
 
 void ThreadPool::clear() {
 
+  // Every thread clears its own state, in parallel. The histories and tables
+  // are then first touched, thus allocated, on the NUMA node the thread is
+  // bound to, instead of the one of the UCI thread.
   for (Thread* th : *this)
-      th->clear();
+      th->start_job([th]{ th->clear(); });
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
 
   main()->callsCnt = 0;
   main()->bestPreviousScore = VALUE_INFINITE;
   main()->previousTimeReduction = 1.0;
+  lastSearch = LastSearch();
+}
+
+
+/// SearchStats::operator+=() adds the counters of another thread
+
+SearchStats& SearchStats::operator+=(const SearchStats& s) {
+
+  searchNodes          += s.searchNodes;
+  qsearchNodes         += s.qsearchNodes;
+  nnueEvals            += s.nnueEvals;
+  classicalEvals       += s.classicalEvals;
+  accumulatorUpdates   += s.accumulatorUpdates;
+  accumulatorRefreshes += s.accumulatorRefreshes;
+  nullMoveTries        += s.nullMoveTries;
+  nullMoveCutoffs      += s.nullMoveCutoffs;
+  probCutCutoffs       += s.probCutCutoffs;
+  singularExtensions   += s.singularExtensions;
+  lmrResearches        += s.lmrResearches;
+  return *this;
+}
+
+
+/// operator<<(SearchStats) prints the counters on a single line. Accumulator
+/// updates and refreshes are counted once per perspective.
+
+std::ostream& operator<<(std::ostream& os, const SearchStats& s) {
+
+  if (!SearchStatsEnabled)
+      return os << "not counted, build with searchstats=yes";
+
+  os << "nodes search " << s.searchNodes << " qsearch " << s.qsearchNodes
+     << " evals nnue " << s.nnueEvals << " classical " << s.classicalEvals
+     << " accumulator update " << s.accumulatorUpdates << " refresh " << s.accumulatorRefreshes
+     << " nullmove tries " << s.nullMoveTries << " cutoffs " << s.nullMoveCutoffs
+     << " probcut cutoffs " << s.probCutCutoffs
+     << " singular extensions " << s.singularExtensions
+     << " lmr researches " << s.lmrResearches;
+
+  return os;
+}
+
+
+/// ThreadPool::search_stats() returns the sum of the counters of all threads
+
+SearchStats ThreadPool::search_stats() const {
+
+  SearchStats sum = SearchStats();
+
+  for (Thread* th : *this)
+      sum += th->stats;
+
+  return sum;
 }
 
 
@@ -177,7 +338,12 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   main()->stopOnPonderhit = stop = false;
   increaseDepth = true;
   main()->ponder = ponderMode;
-  Search::Limits = limits;
+  deterministic = Options()["Deterministic"];
+  abdada = size() > 1 && Options()["SMP Mode"] == "abdada" && !deterministic;
+  qsPrefetch = Options()["QSearch Prefetch"];
+  quantum.arrived = quantum.round = 0;
+  quantum.stop = false;
+  Search::Limits() = limits;
   Search::RootMoves rootMoves;
 
   for (const auto& m : MoveList<LEGAL>(pos))
@@ -188,6 +354,21 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   if (!rootMoves.empty())
       Tablebases::rank_root_moves(pos, rootMoves);
 
+  Depth startDepth =   Options()["Search Reuse"] && limits.searchmoves.empty()
+                    ? reuse_last_search(pos, rootMoves) : 0;
+
+  // With MultiPV Split, the root moves are dealt out to groups of threads, and
+  // each group searches the MultiPV lines of its share of the moves.
+  size_t groups = std::min({ size(), size_t(Options()["MultiPV"]), rootMoves.size() });
+  bool split =   Options()["MultiPV Split"]
+              && groups > 1
+              && int(Options()["Skill Level"]) == 20
+              && !Options()["UCI_LimitStrength"];
+
+  pvSplit.groups = split ? groups : 0;
+  pvSplit.lines.assign(pvSplit.groups, Search::RootMoves());
+  pvSplit.depths.assign(pvSplit.groups, 0);
+
   // After ownership transfer 'states' becomes empty, so if we stop the search
   // and call 'go' again without setting a new position states.get() == NULL.
   assert(states.get() || setupStates.get());
@@ -203,8 +384,19 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   for (Thread* th : *this)
   {
       th->nodes = th->tbHits = th->nmpMinPly = th->bestMoveChanges = 0;
-      th->rootDepth = th->completedDepth = 0;
+      th->rootDepth = std::max(startDepth - 1, 0);
+      th->completedDepth = 0;
+      th->stats = SearchStats();
+      th->ttLog.resize(deterministic ? TTLog::Slots : 0);
+      th->nextQuantum = QuantumNodes;
       th->rootMoves = rootMoves;
+
+      if (pvSplit.groups)
+      {
+          th->rootMoves.clear();
+          for (size_t i = th->id() % pvSplit.groups; i < rootMoves.size(); i += pvSplit.groups)
+              th->rootMoves.push_back(rootMoves[i]);
+      }
       th->rootPos.set(pos.fen(), pos.is_chess960(), &th->rootState, th);
       th->rootState = setupStates->back();
   }
@@ -212,6 +404,90 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   main()->start_searching();
 }
 
+/// ThreadPool::reuse_last_search() checks whether the root position is reached
+/// within two plies along one of the PV lines of the last search. If so, the
+/// first move of the rest of the line is put in front of the root moves, with
+/// the rest of the line as PV and the score of the line, which centers the first
+/// aspiration window, and the depth to start the iterative deepening from is
+/// returned. Otherwise it returns 0 and the search starts from scratch.
+
+Depth ThreadPool::reuse_last_search(const Position& pos, Search::RootMoves& rootMoves) {
+
+  if (lastSearch.lines.empty() || lastSearch.chess960 != pos.is_chess960())
+      return 0;
+
+  StateInfo st[3];
+  Position p;
+
+  for (const Search::RootMove& line : lastSearch.lines)
+  {
+      // Replaying the line counts nodes of the main thread, which are reset
+      // when the search starts.
+      p.set(lastSearch.fen, lastSearch.chess960, &st[0], main());
+
+      for (size_t ply = 1; ply <= 2 && ply < line.pv.size(); ++ply)
+      {
+          p.do_move(line.pv[ply - 1], st[ply]);
+
+          if (p.key() != pos.key())
+              continue;
+
+          auto rm = std::find(rootMoves.begin(), rootMoves.end(), line.pv[ply]);
+          if (rm == rootMoves.end() || rm->tbRank != rootMoves[0].tbRank)
+              return 0;
+
+          rm->pv.assign(line.pv.begin() + ply, line.pv.end());
+          rm->score = ply % 2 ? -line.score : line.score;
+          std::rotate(rootMoves.begin(), rm, rm + 1);
+
+          // Only skip the first iterations: deeper ones find more than the TT
+          // already holds from the last search, and fill the histories.
+          return (lastSearch.depth - int(ply)) / 3;
+      }
+  }
+
+  return 0;
+}
+
+
+/// ThreadPool::start_analysis() wakes up main thread to analyze a batch of
+/// positions and returns immediately. The positions are not split between the
+/// threads as in a normal search: each thread takes a whole position from the
+/// queue and streams its result when done, see Thread::analyze().
+
+void ThreadPool::start_analysis(std::vector<std::string>& fens,
+                                const Search::LimitsType& limits, bool chess960) {
+
+  main()->wait_for_search_finished();
+
+  stop = false;
+  increaseDepth = true;
+  main()->ponder = false;
+  Search::Limits() = limits;
+  Tablebases::set_probe_limits();
+
+  // Each thread searches its own position, so the threads do not share nodes
+  pvSplit.groups = 0;
+  deterministic = false;
+  abdada = false;
+  qsPrefetch = Options()["QSearch Prefetch"];
+  for (Thread* th : *this)
+  {
+      th->stats = SearchStats();
+      th->ttLog.resize(0);
+  }
+
+  analysis = new AnalysisQueue();
+  analysis->fens.swap(fens);
+  analysis->next = analysis->done = 0;
+  analysis->nodes = 0;
+  analysis->chess960 = chess960;
+  analysis->startTime = limits.startTime;
+
+  TT().new_search();
+  main()->start_searching();
+}
+
 Thread* ThreadPool::get_best_thread() const {
 
     Thread* bestThread = front();
@@ -21,8 +21,10 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include "material.h"
@@ -31,9 +33,39 @@
 #include "position.h"
 #include "search.h"
 #include "thread_win32_osx.h"
+#include "tt.h"
 
 namespace Stockfish {
 
+class Engine;
+struct ThreadPool;
+
+/// SearchStats holds the counters of the search of a thread, used to see where
+/// the nodes and the time go. They are plain counters updated by their thread
+/// only, aligned to a cache line so that the threads never share one. They are
+/// only updated in builds with SEARCH_STATS, as they cost some work on every
+/// node.
+
+#if defined(SEARCH_STATS)
+constexpr bool SearchStatsEnabled = true;
+#else
+constexpr bool SearchStatsEnabled = false;
+#endif
+
+struct alignas(64) SearchStats {
+
+  SearchStats& operator+=(const SearchStats& s);
+
+  uint64_t searchNodes = 0, qsearchNodes = 0;
+  uint64_t nnueEvals = 0, classicalEvals = 0;
+  uint64_t accumulatorUpdates = 0, accumulatorRefreshes = 0;
+  uint64_t nullMoveTries = 0, nullMoveCutoffs = 0;
+  uint64_t probCutCutoffs = 0, singularExtensions = 0, lmrResearches = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const SearchStats& s);
+
+
 /// Thread class keeps together all the thread-related stuff. We use
 /// per-thread pawn and material hash tables so that once we get a
 /// pointer to an entry its life time is unlimited and we don't have
@@ -44,18 +76,29 @@ class Thread {
   std::mutex mutex;
   std::condition_variable cv;
   size_t idx;
-  bool exit = false, searching = true; // Set before starting std::thread
+  Engine* engine; // The engine owning the thread pool
+  ThreadPool& pool; // Pool and hash table of the engine, cached for the search
+  TranspositionTable& table;
+  bool exit = false; // Set before starting std::thread
+  std::atomic_bool searching { true }; // Also read while spinning, see idle_loop()
+  std::function<void()> job; // Run instead of a search, see start_job()
   NativeThread stdThread;
 
 public:
   explicit Thread(size_t);
   virtual ~Thread();
   virtual void search();
+  void analyze();
+  void end_quantum();
   void clear();
   void idle_loop();
   void start_searching();
+  void start_job(std::function<void()>);
   void wait_for_search_finished();
   size_t id() const { return idx; }
+  ThreadPool& threads() const { return pool; }
+  TranspositionTable& tt() const { return table; }
+  bool is_searching() const { return searching; }
 
   Pawns::Table pawnsTable;
   Material::Table materialTable;
@@ -75,6 +118,12 @@ public:
   CapturePieceToHistory captureHistory;
   ContinuationHistory continuationHistory[2][2];
   Score trend;
+  bool stopBatch = false;
+  TTStats ttStats;
+  QSearchTable qsTable;
+  SearchStats stats;
+  TTLog ttLog;
+  uint64_t nextQuantum;
 };
 
 
@@ -96,6 +145,78 @@ struct MainThread : public Thread {
 };
 
 
+/// AnalysisQueue holds the positions of an 'analyze' batch. Every thread takes
+/// the next unclaimed position, searches it on its own up to the batch limit,
+/// and then moves on to the next one until the queue is exhausted.
+
+struct AnalysisQueue {
+  std::vector<std::string> fens;
+  std::atomic<size_t> next, done;
+  std::atomic<uint64_t> nodes;
+  bool chess960;
+  TimePoint startTime;
+};
+
+
+/// PerftSplit holds the work of a perft of depth 3 or more: the pairs of a root
+/// move and one of its replies. Every thread claims the next unclaimed pair and
+/// stores the leaf count below it, see MainThread::search().
+
+struct PerftSplit {
+  std::vector<std::pair<Move, Move>> moves;
+  std::vector<uint64_t> counts;
+  std::atomic<size_t> next;
+};
+
+
+/// PVSplit holds the state of a search with the MultiPV lines split between
+/// groups of threads, each group searching its own share of the root moves. The
+/// first thread of each group publishes the lines of its last completed iteration,
+/// and the main thread merges them with its own, see Search::info_lines().
+
+struct PVSplit {
+  size_t groups = 0; // Zero when the lines are not split
+  std::mutex mutex;
+  std::vector<Search::RootMoves> lines;
+  std::vector<Depth> depths;
+};
+
+
+/// LastSearch keeps the root and the PV lines of the last search. When the next
+/// root is reached from it along one of the lines, as after the expected reply in
+/// a game, the new search picks up the rest of that line, see reuse_last_search().
+
+struct LastSearch {
+  std::string fen;
+  bool chess960 = false;
+  Depth depth = 0;
+  Search::RootMoves lines;
+};
+
+
+/// QuantumSync is the barrier of the deterministic search mode, which every
+/// thread reaches at the end of each quantum of nodes, see Thread::end_quantum().
+/// The stop flag of the search is only raised at the barrier.
+
+struct QuantumSync {
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t arrived;
+  uint64_t round;
+  bool stop;
+};
+
+
+/// NodeMark is a slot of the table used by the 'abdada' SMP mode. A thread marks
+/// the node it is searching in the slot of its key, and while the mark is set
+/// the other threads defer the moves leading to that node, see search().
+
+struct NodeMark {
+  std::atomic<Thread*> thread;
+  std::atomic<Key> key;
+};
+
+
 /// ThreadPool struct handles all the threads-related stuff like init, starting,
 /// parking and, most importantly, launching a thread. All the access to threads
 /// is done through this class.
@@ -103,17 +224,33 @@ struct MainThread : public Thread {
 struct ThreadPool : public std::vector<Thread*> {
 
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
+  void start_analysis(std::vector<std::string>&, const Search::LimitsType&, bool chess960);
   void clear();
   void set(size_t);
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
   uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
+  SearchStats search_stats() const;
   Thread* get_best_thread() const;
   void start_searching();
   void wait_for_search_finished() const;
+  Depth reuse_last_search(const Position&, Search::RootMoves&);
+
+  static constexpr size_t NodeMarkCount = 4096;
+  static constexpr uint64_t QuantumNodes = 4096;
 
   std::atomic_bool stop, increaseDepth;
+  AnalysisQueue* analysis = nullptr;
+  bool abdada = false;
+  bool deterministic = false;
+  bool qsPrefetch = false;
+  QuantumSync quantum;
+  NodeMark nodeMarks[NodeMarkCount];
+  PVSplit pvSplit;
+  LastSearch lastSearch;
+  PerftSplit perftSplit;
+  PerftTable perftTable;
 
 private:
   StateListPtr setupStates;
@@ -127,8 +264,6 @@ private:
   }
 };
 
-extern ThreadPool Threads;
-
 } // namespace Stockfish
 
 #endif // #ifndef THREAD_H_INCLUDED
@@ -18,17 +18,72 @@
 
 #include <algorithm>
 #include <cfloat>
+#include <chrono>
 #include <cmath>
 
+#include "engine.h"
 #include "search.h"
 #include "timeman.h"
 #include "uci.h"
 
 namespace Stockfish {
 
-TimeManagement Time; // Our global time management object
+namespace {
+
+  int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>
+          (std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+} // namespace
+
+
+/// MoveLatency::command_received() is called by the UCI loop when it has read
+/// a command line.
+
+void MoveLatency::command_received() { commandTime = now_us(); }
+
+
+/// MoveLatency::go_received() is called by the UCI thread when it parses 'go',
+/// just after setting the start time of the limits.
+
+void MoveLatency::go_received() {
+  inputDelay = commandTime ? now_us() - commandTime : 0;
+  commandTime = 0;
+}
+
+
+/// MoveLatency::search_ended() is called by the main thread when the search is
+/// over, that is its own search returned and, when pondering or in an infinite
+/// search, 'stop' or 'ponderhit' arrived.
+
+void MoveLatency::search_ended() { endTime = now_us(); }
 
 
+/// MoveLatency::bestmove_sent() completes the sample of the move, and updates
+/// the floor of the move overhead to the 95th percentile of the last samples,
+/// rounded up to the millisecond.
+
+void MoveLatency::bestmove_sent() {
+
+  samples[samplesCnt++ % Samples] = inputDelay + now_us() - endTime;
+
+  std::array<int64_t, Samples> sorted = samples;
+  auto last = sorted.begin() + count();
+  auto p95 = sorted.begin() + count() * 95 / 100;
+
+  std::nth_element(sorted.begin(), p95, last);
+  floorTime = TimePoint((*p95 + 999) / 1000);
+}
+
+
+/// TimeManagement::elapsed() returns the time spent since the start of the
+/// search, or the number of searched nodes in 'nodes as time' mode.
+
+TimePoint TimeManagement::elapsed() const {
+  return Search::Limits().npmsec ? TimePoint(Threads().nodes_searched()) : now() - startTime;
+}
+
 /// TimeManagement::init() is called at the beginning of the search and calculates
 /// the bounds of time allowed for the current game ply. We currently support:
 //      1) x basetime (+ z increment)
@@ -36,9 +91,9 @@ TimeManagement Time; // Our global time management object
 
 void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
 
-  TimePoint moveOverhead    = TimePoint(Options["Move Overhead"]);
-  TimePoint slowMover       = TimePoint(Options["Slow Mover"]);
-  TimePoint npmsec          = TimePoint(Options["nodestime"]);
+  TimePoint moveOverhead    = std::max(TimePoint(Options()["Move Overhead"]), latency.floor());
+  TimePoint slowMover       = TimePoint(Options()["Slow Mover"]);
+  TimePoint npmsec          = TimePoint(Options()["nodestime"]);
 
   // optScale is a percentage of available time to use for the current move.
   // maxScale is a multiplier applied to optimumTime.
@@ -59,7 +114,24 @@ void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
       limits.npmsec = npmsec;
   }
 
+  // Report the measured floor of the move overhead when it changes
+  if (limits.use_time_management() && latency.floor() != reportedFloor)
+  {
+      if (!Engine::current().onInfo)
+          sync_cout << "info string Move Overhead floor " << latency.floor()
+                    << " ms, 95th percentile of the last " << latency.count() << " moves" << sync_endl;
+
+      reportedFloor = latency.floor();
+  }
   startTime = limits.startTime;
+  gamePly = ply;
+  adaptive = Options()["Adaptive Time"];
+  lastNodes = lastIterationNodes = 0;
+  lastGrowth = 0;
+
+  log.close();
+  if (!(Options()["Time Log File"] == "<empty>") && limits.use_time_management())
+      log.open(std::string(Options()["Time Log File"]), std::ios::app);
 
   // Maximum move horizon of 50 moves
   int mtg = limits.movestogo ? std::min(limits.movestogo, 50) : 50;
@@ -94,8 +166,66 @@ void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
   optimumTime = TimePoint(optScale * timeLeft);
   maximumTime = TimePoint(std::min(0.8 * limits.time[us] - moveOverhead, maxScale * optimumTime));
 
-  if (Options["Ponder"])
+  if (Options()["Ponder"])
       optimumTime += optimumTime / 4;
 }
 
+
+/// TimeManagement::predict_iteration() is called at the end of each iteration
+/// of the main thread, with the nodes searched so far by all the threads, and
+/// returns the expected time of the next iteration: the nodes of the last one,
+/// scaled by the growth of the node count over the last iterations, at the speed
+/// measured since the start. It returns 0 until two iterations are known. With
+/// Time Log File, the prediction is logged with the limits of the move.
+
+TimePoint TimeManagement::predict_iteration(Depth depth, uint64_t nodes) {
+
+  TimePoint spent = elapsed();
+  uint64_t iterationNodes = nodes - lastNodes;
+  double growth = 0;
+
+  // The growth is averaged over two iterations, since the node counts of odd
+  // and even depths differ, and clamped against TT hits and fail-low re-searches.
+  if (lastIterationNodes)
+  {
+      growth = std::clamp(double(iterationNodes) / lastIterationNodes, 1.0, 8.0);
+      if (lastGrowth)
+          growth = std::sqrt(growth * lastGrowth);
+      lastGrowth = growth;
+  }
+
+  lastNodes = nodes;
+  lastIterationNodes = iterationNodes;
+
+  // In 'nodes as time' mode the elapsed time is the node count itself
+  TimePoint predicted = TimePoint(growth * iterationNodes * spent / std::max(nodes, uint64_t(1)));
+
+  if (log.is_open())
+      log << gamePly << ',' << depth << ',' << spent << ',' << nodes << ','
+          << predicted << ',' << optimumTime << ',' << maximumTime << std::endl;
+
+  return predicted;
+}
+
+
+/// TimeManagement::next_iteration_fits() tells whether the next iteration, of
+/// the predicted time, is expected to finish before the maximum time. Without
+/// Adaptive Time, or without a prediction yet, it always does.
+
+bool TimeManagement::next_iteration_fits(TimePoint predicted) const {
+
+  return !adaptive || !predicted || elapsed() + predicted <= maximumTime;
+}
+
+
+/// TimeManagement::log_end() logs the end of the search, which bounds the time of
+/// the last, unfinished, iteration.
+
+void TimeManagement::log_end(uint64_t nodes) {
+
+  if (log.is_open())
+      log << gamePly << ",end," << elapsed() << ',' << nodes << ",,"
+          << optimumTime << ',' << maximumTime << std::endl;
+}
+
 } // namespace Stockfish
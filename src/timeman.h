@@ -19,33 +19,70 @@
 #ifndef TIMEMAN_H_INCLUDED
 #define TIMEMAN_H_INCLUDED
 
+#include <array>
+#include <fstream>
+
 #include "misc.h"
 #include "search.h"
 #include "thread.h"
 
 namespace Stockfish {
 
+/// MoveLatency measures, for every move under time control, the time the engine
+/// is on the clock but not on the search clock: from the reading of the 'go' line to the start
+/// time of the limits, and from the end of the search to the flush of 'bestmove'.
+/// The time in between is already counted by the search. The 95th percentile
+/// over the last moves is used as a floor of the Move Overhead option.
+
+class MoveLatency {
+public:
+  void command_received();
+  void go_received();
+  void search_ended();
+  void bestmove_sent();
+  TimePoint floor() const { return floorTime; }
+  size_t count() const { return std::min(samplesCnt, Samples); }
+
+private:
+  static constexpr size_t Samples = 64;
+
+  int64_t commandTime = 0, inputDelay = 0, endTime = 0; // In microseconds
+  std::array<int64_t, Samples> samples;
+  size_t samplesCnt = 0;
+  TimePoint floorTime = 0;
+};
+
+
 /// The TimeManagement class computes the optimal time to think depending on
 /// the maximum available time, the game move number and other parameters.
+/// During the search it also predicts the time of the next iteration from the
+/// measured speed of the search, see predict_iteration().
 
 class TimeManagement {
 public:
   void init(Search::LimitsType& limits, Color us, int ply);
   TimePoint optimum() const { return optimumTime; }
   TimePoint maximum() const { return maximumTime; }
-  TimePoint elapsed() const { return Search::Limits.npmsec ?
-                                     TimePoint(Threads.nodes_searched()) : now() - startTime; }
+  TimePoint elapsed() const;
+  TimePoint predict_iteration(Depth depth, uint64_t nodes);
+  bool next_iteration_fits(TimePoint predicted) const;
+  void log_end(uint64_t nodes);
 
   int64_t availableNodes; // When in 'nodes as time' mode
+  MoveLatency latency;
 
 private:
   TimePoint startTime;
   TimePoint optimumTime;
   TimePoint maximumTime;
+  int gamePly;
+  bool adaptive;
+  uint64_t lastNodes, lastIterationNodes;
+  double lastGrowth;
+  std::ofstream log;
+  TimePoint reportedFloor = 0;
 };
 
-extern TimeManagement Time;
-
 } // namespace Stockfish
 
 #endif // #ifndef TIMEMAN_H_INCLUDED
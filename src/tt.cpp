@@ -16,11 +16,26 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <cstring>   // For std::memset
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>   // For std::memset and std::memcpy
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <numeric>
+#include <sstream>
 #include <thread>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "bitboard.h"
+#include "engine.h"
 #include "misc.h"
 #include "thread.h"
 #include "tt.h"
@@ -28,47 +43,236 @@
 
 namespace Stockfish {
 
-TranspositionTable TT; // Our global transposition table
+namespace {
+
+  // Counters of the calling thread. Threads that are not search threads share
+  // a dummy instance, whose counters are never reported.
+  TTStats unboundStats;
+  thread_local TTStats* localStats = &unboundStats;
+}
+
+void TTStats::bind(TTStats* s) { localStats = s; }
 
 /// TTEntry::save() populates the TTEntry with a new node's data, possibly
-/// overwriting an old position. Update is not atomic and can be racy.
+/// overwriting an old position. Update is not atomic and can be racy, the
+/// key is written last so that with TT_LOCKLESS it seals the other fields.
+
+template<typename KeyType>
+void TTEntryT<KeyType>::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
 
-void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
+  const bool sameKey = (KeyType)k == key();
 
   // Preserve any existing move for the same position
-  if (m || (uint16_t)k != key16)
+  if (m || !sameKey)
       move16 = (uint16_t)m;
 
   // Overwrite less valuable entries (cheapest checks first)
   if (b == BOUND_EXACT
-      || (uint16_t)k != key16
+      || !sameKey
       || d - DEPTH_OFFSET > depth8 - 4)
   {
       assert(d > DEPTH_OFFSET);
       assert(d < 256 + DEPTH_OFFSET);
 
-      key16     = (uint16_t)k;
+      if constexpr (TTStatsEnabled)
+      {
+          if (sameKey && depth8)
+              localStats->sameKeyOverwrites++;
+
+          else if (!sameKey && depth8)
+          {
+              localStats->replaced[TTStats::depth_class(depth())]++;
+              localStats->ageEvictions += (genBound8 & TT().GENERATION_MASK) != TT().generation8;
+          }
+      }
+
       depth8    = (uint8_t)(d - DEPTH_OFFSET);
-      genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
+      genBound8 = (uint8_t)(TT().generation8 | uint8_t(pv) << 2 | b);
       value16   = (int16_t)v;
       eval16    = (int16_t)ev;
   }
+
+  seal((KeyType)k);
 }
 
 
+namespace {
+
+#if !defined(_WIN32) && !defined(__ANDROID__)
+
+  // A shared table starts with a header of one page, used to check that all
+  // the attached processes agree on the layout of the table.
+  // Builds with and without TT_LOCKLESS store the keys differently.
+  constexpr size_t SharedHeaderSize = 4096;
+#if defined(TT_LOCKLESS)
+  constexpr char SharedMagic[8] = "SF-SHML";
+#else
+  constexpr char SharedMagic[8] = "SF-SHM";
+#endif
+
+  struct SharedHeader {
+    char magic[8];
+    uint64_t clusterSize;
+    uint64_t entrySize;
+    std::atomic<uint64_t> users; // Attached tables, zero in a new segment
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared counter needs lock-free atomics");
+
+  std::string shared_path(const std::string& name) { return name[0] == '/' ? name : "/" + name; }
+
+  /// shared_alloc() creates the named POSIX shared memory segment, or attaches
+  /// to it if it exists already with the same size, and maps it. A new segment
+  /// is zero-filled by the kernel. Returns the table, after the header, or
+  /// nullptr in case of failure.
+
+  void* shared_alloc(const std::string& name, size_t size, size_t clusterSize, size_t entrySize) {
+
+    const std::string path = shared_path(name);
+    const size_t mapSize = SharedHeaderSize + size;
+    struct stat statbuf;
+
+    int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd == -1)
+        return nullptr;
+
+    // Do not resize a segment already in use by another process
+    if (   fstat(fd, &statbuf)
+        || (statbuf.st_size && size_t(statbuf.st_size) != mapSize)
+        || (!statbuf.st_size && ftruncate(fd, off_t(mapSize))))
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void* mem = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mem == MAP_FAILED)
+        return nullptr;
+
+#if defined(MADV_HUGEPAGE)
+    madvise(mem, mapSize, MADV_HUGEPAGE);
+#endif
+
+    // Header of a new segment is all zeros. Concurrent writers store the same data.
+    SharedHeader* h = static_cast<SharedHeader*>(mem);
+    if (!h->clusterSize)
+    {
+        std::memcpy(h->magic, SharedMagic, sizeof(SharedMagic));
+        h->clusterSize = clusterSize;
+        h->entrySize   = entrySize;
+    }
+
+    if (std::memcmp(h->magic, SharedMagic, sizeof(SharedMagic)) || h->clusterSize != clusterSize || h->entrySize != entrySize)
+    {
+        munmap(mem, mapSize);
+        return nullptr;
+    }
+
+    h->users++;
+
+    return static_cast<char*>(mem) + SharedHeaderSize;
+  }
+
+  /// shared_free() unmaps the table. The last table to detach also removes the
+  /// name of the segment, whose memory is then released by the kernel.
+
+  void shared_free(void* mem, size_t size, const std::string& name) {
+
+    SharedHeader* h = reinterpret_cast<SharedHeader*>(static_cast<char*>(mem) - SharedHeaderSize);
+
+    if (h->users-- == 1)
+        shm_unlink(shared_path(name).c_str());
+
+    munmap(h, SharedHeaderSize + size);
+  }
+
+  uint64_t shared_users(const void* mem) {
+    return reinterpret_cast<const SharedHeader*>(static_cast<const char*>(mem) - SharedHeaderSize)->users;
+  }
+
+  /// shared_unlink() removes the name of a segment, for instance one left over by
+  /// a process that crashed. Processes still attached keep their mapping.
+
+  bool shared_unlink(const std::string& name) { return !shm_unlink(shared_path(name).c_str()); }
+
+#else
+
+  void* shared_alloc(const std::string&, size_t, size_t, size_t) { return nullptr; }
+  void shared_free(void*, size_t, const std::string&) {}
+  uint64_t shared_users(const void*) { return 1; }
+  bool shared_unlink(const std::string&) { return false; }
+
+#endif
+
+} // namespace
+
+
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// If the 'Hash Shared Name' option is set, the table is placed in a named
+/// shared memory segment, so that several engine processes share one table.
+/// With 'Rehash On Resize' the entries of a private table are moved to the
+/// new one instead of being cleared, see rehash().
 
-void TranspositionTable::resize(size_t mbSize) {
+template<typename KeyType, int ClusterSize>
+void TranspositionTableT<KeyType, ClusterSize>::resize(size_t mbSize) {
 
-  Threads.main()->wait_for_search_finished();
+  Threads().main()->wait_for_search_finished();
 
-  aligned_large_pages_free(table);
+  Cluster* oldTable = nullptr;
+  const size_t oldCount = clusterCount;
+
+  // Keep the old table alive until its entries are moved
+  if (Options()["Rehash On Resize"] && table && !shared)
+      oldTable = table, table = nullptr;
+  else
+      release();
 
   clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
 
-  table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+  const std::string sharedName = Options()["Hash Shared Name"];
+
+  if (sharedName != "<empty>")
+  {
+      table = static_cast<Cluster*>(shared_alloc(sharedName, clusterCount * sizeof(Cluster), sizeof(Cluster), sizeof(Entry)));
+      shared = table != nullptr;
+      segmentName = sharedName;
+
+      // All the processes see the clusters of a shared table with epoch 0, as
+      // the epoch bumped by the clear() of a private table is not shared.
+      if (shared)
+          epoch = 0;
+
+      if (!shared)
+          sync_cout << "info string Failed to attach shared hash " << sharedName
+                    << ", using a private hash" << sync_endl;
+  }
+
+  if (!shared)
+  {
+      const size_t pageSize = Options()["Huge Pages"] == "1GB" ? 1024 * 1024 * 1024
+                            : Options()["Huge Pages"] == "2MB" ? 2 * 1024 * 1024 : 0;
+
+      table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster), pageSize));
+
+      // Tell which pages were obtained, as the pool of huge pages may be too small
+      if (table && pageSize)
+      {
+          const size_t obtained = huge_page_size(table);
+
+          if (obtained)
+              sync_cout << "info string Hash allocated with "
+                        << (obtained == 1024 * 1024 * 1024 ? "1GB" : "2MB")
+                        << " pages" << sync_endl;
+          else
+              sync_cout << "info string No " << std::string(Options()["Huge Pages"])
+                        << " huge pages available, hash allocated with default pages" << sync_endl;
+      }
+  }
+
   if (!table)
   {
       std::cerr << "Failed to allocate " << mbSize
@@ -76,37 +280,392 @@ void TranspositionTable::resize(size_t mbSize) {
       exit(EXIT_FAILURE);
   }
 
-  clear();
+  // Memory policy must be set before the first touch, done in zero()
+  if (Options()["NUMA Policy"] == "interleave")
+      Numa::interleaveMemory(table, clusterCount * sizeof(Cluster));
+
+  // A shared table is zeroed when the segment is created, and
+  // must not be cleared under the feet of the other processes.
+  if (oldTable && !shared)
+      rehash(oldTable, oldCount);
+  else if (!shared)
+      zero();
+
+  aligned_large_pages_free(oldTable);
+}
+
+
+/// TranspositionTable::release() frees the memory of the table
+
+template<typename KeyType, int ClusterSize>
+void TranspositionTableT<KeyType, ClusterSize>::release() {
+
+  if (shared)
+      shared_free(table, clusterCount * sizeof(Cluster), segmentName);
+  else
+      aligned_large_pages_free(table);
+
+  table = nullptr;
+  shared = false;
+}
+
+
+/// TranspositionTable::clear() empties the transposition table in constant time,
+/// by incrementing the epoch of the table: a cluster with another epoch is seen
+/// as empty by hashfull() and stats(), and is zeroed by probe() on its first
+/// access, exactly as if the whole table had been zeroed. Only when the epoch
+/// wraps around the table is zeroed for real. The epoch is private to the
+/// process, so a shared table keeps epoch 0, which all the attached processes
+/// use: it is zeroed for real instead, and only when no other process is
+/// attached to it, not to wipe their entries under their feet.
+
+template<typename KeyType, int ClusterSize>
+void TranspositionTableT<KeyType, ClusterSize>::clear() {
+
+  if (shared)
+  {
+      if (shared_users(table) == 1)
+          zero();
+      else
+          sync_cout << "info string Shared hash not cleared, other processes use it" << sync_endl;
+  }
+  else if (++epoch == 0)
+      zero();
+}
+
+
+/// TranspositionTable::unlink_shared() removes the shared memory segment of the
+/// given name. The processes attached to it keep using it until they detach,
+/// then its memory is released.
+
+template<typename KeyType, int ClusterSize>
+bool TranspositionTableT<KeyType, ClusterSize>::unlink_shared(const std::string& name) {
+
+  return name != "<empty>" && shared_unlink(name);
 }
 
 
-/// TranspositionTable::clear() initializes the entire transposition table to zero,
-//  in a multi-threaded way.
+/// TranspositionTable::zero() initializes the entire transposition table to zero,
+/// in a multi-threaded way, and resets the epoch of the table.
+
+template<typename KeyType, int ClusterSize>
+void TranspositionTableT<KeyType, ClusterSize>::zero() {
 
-void TranspositionTable::clear() {
+  epoch = 0;
 
   std::vector<std::thread> threads;
 
-  for (size_t idx = 0; idx < Options["Threads"]; ++idx)
+  Engine& engine = Engine::current(); // Workers use the options of the caller
+
+  for (size_t idx = 0; idx < Options()["Threads"]; ++idx)
   {
-      threads.emplace_back([this, idx]() {
+      threads.emplace_back([this, idx, &engine]() {
+
+          Engine::Scope scope(engine);
 
           // Thread binding gives faster search on systems with a first-touch policy
-          if (Options["Threads"] > 8)
+          if (Options()["Threads"] > 8)
               WinProcGroup::bindThisThread(idx);
 
+          if (!(Options()["NUMA Policy"] == "none"))
+              Numa::bindThisThread(idx);
+
           // Each thread will zero its part of the hash table
-          const size_t stride = size_t(clusterCount / Options["Threads"]),
+          const size_t stride = size_t(clusterCount / Options()["Threads"]),
+                       start  = size_t(stride * idx),
+                       len    = idx != Options()["Threads"] - 1 ?
+                                stride : clusterCount - start;
+
+          // With the 'partition' policy each part lives on the node of the
+          // search thread with the same index.
+          if (Options()["NUMA Policy"] == "partition")
+              Numa::bindMemory(&table[start], len * sizeof(Cluster), Numa::nodeOf(idx));
+
+          std::memset(&table[start], 0, len * sizeof(Cluster));
+      });
+  }
+
+  for (std::thread& th : threads)
+      th.join();
+}
+
+
+namespace {
+
+  // Returns a * b / c, rounded down or up, without overflow when 128 bit
+  // integers are available. Otherwise the result may be off by one, which
+  // only makes rehash() misplace a few entries at the cluster boundaries.
+  uint64_t mul_div(uint64_t a, uint64_t b, uint64_t c, bool roundUp) {
+#if defined(__GNUC__) && defined(IS_64BIT)
+    __extension__ typedef unsigned __int128 uint128;
+    return uint64_t(((uint128)a * b + (roundUp ? c - 1 : 0)) / c);
+#else
+    const double q = double(a) * double(b) / double(c);
+    return uint64_t(roundUp ? std::ceil(q) : q);
+#endif
+  }
+}
+
+
+/// TranspositionTable::rehash() fills the new table with the entries of the
+/// old one, in a multi-threaded way, each thread handling its part of the new
+/// table. Only the low bits of the key are stored in an entry, so the new
+/// cluster of an entry is known only from the position of its old cluster: the
+/// keys of old cluster i can go to the new clusters j such that the ranges
+/// [i / oldCount, (i + 1) / oldCount) and [j / clusterCount, (j + 1) / clusterCount)
+/// intersect. When the table shrinks, entries of the old clusters straddling two
+/// new clusters are dropped. When it grows, entries are copied in all their
+/// candidate clusters, and the copies that do not match any position are
+/// eventually replaced. In both cases the least valuable entries are dropped
+/// first when a new cluster is full.
+
+template<typename KeyType, int ClusterSize>
+void TranspositionTableT<KeyType, ClusterSize>::rehash(const Cluster* oldTable, size_t oldCount) {
+
+  std::vector<std::thread> threads;
+  const uint16_t oldEpoch = epoch;
+
+  Engine& engine = Engine::current();
+
+  for (size_t idx = 0; idx < Options()["Threads"]; ++idx)
+  {
+      threads.emplace_back([this, idx, oldTable, oldCount, oldEpoch, &engine]() {
+
+          Engine::Scope scope(engine);
+
+          // Thread binding gives faster search on systems with a first-touch policy
+          if (Options()["Threads"] > 8)
+              WinProcGroup::bindThisThread(idx);
+
+          if (!(Options()["NUMA Policy"] == "none"))
+              Numa::bindThisThread(idx);
+
+          // Each thread will fill its part of the new hash table
+          const size_t stride = size_t(clusterCount / Options()["Threads"]),
                        start  = size_t(stride * idx),
-                       len    = idx != Options["Threads"] - 1 ?
+                       len    = idx != Options()["Threads"] - 1 ?
                                 stride : clusterCount - start;
 
+          if (Options()["NUMA Policy"] == "partition")
+              Numa::bindMemory(&table[start], len * sizeof(Cluster), Numa::nodeOf(idx));
+
           std::memset(&table[start], 0, len * sizeof(Cluster));
+
+          // Old clusters intersecting the new clusters [start, start + len)
+          const size_t first = mul_div(start, oldCount, clusterCount, false),
+                       last  = std::min(mul_div(start + len, oldCount, clusterCount, true), oldCount);
+
+          for (size_t i = first; i < last; ++i)
+          {
+              const size_t lo = mul_div(i, clusterCount, oldCount, false),
+                           hi = mul_div(i + 1, clusterCount, oldCount, true);
+
+              if (   oldTable[i].epoch != oldEpoch
+                  || (clusterCount < oldCount && hi - lo > 1))
+                  continue;
+
+              for (size_t j = std::max(lo, start); j < std::min(hi, start + len); ++j)
+                  for (const Entry& e : oldTable[i].entry)
+                  {
+                      if (!e.depth8)
+                          continue;
+
+                      // Take an empty slot or replace the least valuable entry
+                      Entry* replace = &table[j].entry[0];
+                      for (Entry& tte : table[j].entry)
+                          if (!tte.depth8 || replace_value(tte) < replace_value(*replace))
+                          {
+                              replace = &tte;
+                              if (!tte.depth8)
+                                  break;
+                          }
+
+                      if (!replace->depth8 || replace_value(*replace) < replace_value(e))
+                          *replace = e;
+                  }
+          }
       });
   }
 
   for (std::thread& th : threads)
       th.join();
+
+  epoch = 0; // The epoch of the new clusters
+}
+
+
+namespace {
+
+  // A hash file starts with a header of one page, so that the clusters that
+  // follow it are page aligned in the file and can be mapped directly.
+  constexpr size_t HeaderSize = 4096;
+#if defined(TT_LOCKLESS)
+  constexpr char FileMagic[8] = "SF-LHSH";
+#else
+  constexpr char FileMagic[8] = "SF-HASH";
+#endif
+
+  struct FileHeader {
+    char magic[8];
+    uint64_t clusterSize;
+    uint64_t clusterCount;
+    uint64_t entrySize;
+    uint16_t epoch;
+    uint8_t generation8;
+  };
+}
+
+
+/// TranspositionTable::save() writes the header and all the clusters of the
+/// transposition table to the given file.
+
+template<typename KeyType, int ClusterSize>
+bool TranspositionTableT<KeyType, ClusterSize>::save(const std::string& fname) const {
+
+  Threads().main()->wait_for_search_finished();
+
+  std::ofstream file(fname, std::ios::binary);
+  char header[HeaderSize] = {};
+  FileHeader h = {};
+
+  std::memcpy(h.magic, FileMagic, sizeof(FileMagic));
+  h.clusterSize  = sizeof(Cluster);
+  h.clusterCount = clusterCount;
+  h.entrySize    = sizeof(Entry);
+  h.epoch        = epoch;
+  h.generation8  = generation8;
+  std::memcpy(header, &h, sizeof(h));
+
+  file.write(header, HeaderSize);
+  file.write(reinterpret_cast<const char*>(table), std::streamsize(clusterCount * sizeof(Cluster)));
+
+  return bool(file);
+}
+
+
+/// TranspositionTable::load() restores a transposition table written by save().
+/// The Hash option is changed if the file has been saved with a different size.
+/// The file is mapped and prefaulted, then copied in a multi-threaded way. The
+/// table keeps its own epoch: the clusters of the epoch of the file are moved to
+/// it, and the stale ones are zeroed. The epoch of a shared table must stay the
+/// one of the other processes attached to it.
+
+template<typename KeyType, int ClusterSize>
+bool TranspositionTableT<KeyType, ClusterSize>::load(const std::string& fname) {
+
+  Threads().main()->wait_for_search_finished();
+
+  FileHeader h;
+  size_t dataSize;
+
+#ifndef _WIN32
+  struct stat statbuf;
+  int fd = ::open(fname.c_str(), O_RDONLY);
+
+  if (fd == -1)
+      return false;
+
+  if (fstat(fd, &statbuf) || size_t(statbuf.st_size) < HeaderSize)
+  {
+      ::close(fd);
+      return false;
+  }
+
+  int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+  flags |= MAP_POPULATE;
+#endif
+  void* data = mmap(nullptr, statbuf.st_size, PROT_READ, flags, fd, 0);
+  ::close(fd);
+
+  if (data == MAP_FAILED)
+      return false;
+
+  std::memcpy(&h, data, sizeof(h));
+  dataSize = size_t(statbuf.st_size) - HeaderSize;
+#else
+  std::ifstream file(fname, std::ios::binary | std::ios::ate);
+
+  if (!file || size_t(file.tellg()) < HeaderSize)
+      return false;
+
+  dataSize = size_t(file.tellg()) - HeaderSize;
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(&h), sizeof(h));
+#endif
+
+  const size_t mbSize = h.clusterCount * sizeof(Cluster) / (1024 * 1024);
+
+  bool ok =   !std::memcmp(h.magic, FileMagic, sizeof(FileMagic))
+           &&  h.clusterSize == sizeof(Cluster)
+           &&  h.entrySize == sizeof(Entry)
+           &&  dataSize == h.clusterCount * sizeof(Cluster)
+           &&  mbSize * 1024 * 1024 == dataSize;
+
+  // Resize through the option, so that it stays in sync with the table
+  if (ok && h.clusterCount != clusterCount)
+  {
+      Options()["Hash"] = std::to_string(mbSize);
+      ok = h.clusterCount == clusterCount;
+  }
+
+  if (ok)
+  {
+#ifndef _WIN32
+      const char* clusters = static_cast<const char*>(data) + HeaderSize;
+      std::vector<std::thread> threads;
+
+      Engine& engine = Engine::current();
+
+      for (size_t idx = 0; idx < Options()["Threads"]; ++idx)
+      {
+          threads.emplace_back([this, idx, clusters, &h, &engine]() {
+
+              Engine::Scope scope(engine);
+
+              // Each thread will copy its part of the hash table
+              const size_t stride = size_t(clusterCount / Options()["Threads"]),
+                           start  = size_t(stride * idx),
+                           len    = idx != Options()["Threads"] - 1 ?
+                                    stride : clusterCount - start;
+
+              std::memcpy(&table[start], clusters + start * sizeof(Cluster), len * sizeof(Cluster));
+              renumber(start, len, h.epoch);
+          });
+      }
+
+      for (std::thread& th : threads)
+          th.join();
+#else
+      file.seekg(HeaderSize);
+      file.read(reinterpret_cast<char*>(table), std::streamsize(dataSize));
+      ok = bool(file);
+      renumber(0, clusterCount, h.epoch);
+#endif
+      generation8 = h.generation8;
+  }
+
+#ifndef _WIN32
+  munmap(data, statbuf.st_size);
+#endif
+
+  return ok;
+}
+
+
+/// TranspositionTable::renumber() moves the given clusters from the epoch of a
+/// loaded file to the epoch of the table, and zeroes those of another epoch.
+
+template<typename KeyType, int ClusterSize>
+void TranspositionTableT<KeyType, ClusterSize>::renumber(size_t start, size_t len, uint16_t fileEpoch) {
+
+  for (size_t i = start; i < start + len; ++i)
+  {
+      if (table[i].epoch != fileEpoch)
+          std::memset(table[i].entry, 0, sizeof(table[i].entry));
+
+      table[i].epoch = epoch;
+  }
 }
 
 
@@ -117,29 +676,44 @@ void TranspositionTable::clear() {
 /// minus 8 times its relative age. TTEntry t1 is considered more valuable than
 /// TTEntry t2 if its replace value is greater than that of t2.
 
-TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+template<typename KeyType, int ClusterSize>
+typename TranspositionTableT<KeyType, ClusterSize>::Entry*
+TranspositionTableT<KeyType, ClusterSize>::probe(const Key key, bool& found) const {
+
+  Cluster* const cluster = &table[mul_hi64(key, clusterCount)];
+  Entry* const tte = &cluster->entry[0];
+  const KeyType keyLow = (KeyType)key;  // Use the low bits as key inside the cluster
+
+  if constexpr (TTStatsEnabled)
+      localStats->probes++;
 
-  TTEntry* const tte = first_entry(key);
-  const uint16_t key16 = (uint16_t)key;  // Use the low 16 bits as key inside the cluster
+  // Lazily zero the clusters left over by clear()
+  if (cluster->epoch != epoch)
+  {
+      std::memset(cluster->entry, 0, sizeof(cluster->entry));
+      cluster->epoch = epoch;
+  }
 
   for (int i = 0; i < ClusterSize; ++i)
-      if (tte[i].key16 == key16 || !tte[i].depth8)
+      if (tte[i].key() == keyLow || !tte[i].depth8)
       {
           tte[i].genBound8 = uint8_t(generation8 | (tte[i].genBound8 & (GENERATION_DELTA - 1))); // Refresh
 
-          return found = (bool)tte[i].depth8, &tte[i];
+          found = (bool)tte[i].depth8;
+
+          if constexpr (TTStatsEnabled)
+          {
+              localStats->hits += found;
+              localStats->emptyHits += !found;
+          }
+
+          return &tte[i];
       }
 
   // Find an entry to be replaced according to the replacement strategy
-  TTEntry* replace = tte;
+  Entry* replace = tte;
   for (int i = 1; i < ClusterSize; ++i)
-      // Due to our packed storage format for generation and its cyclic
-      // nature we add GENERATION_CYCLE (256 is the modulus, plus what
-      // is needed to keep the unrelated lowest n bits from affecting
-      // the result) to calculate the entry age correctly even after
-      // generation8 overflows into the next cycle.
-      if (  replace->depth8 - ((GENERATION_CYCLE + generation8 - replace->genBound8) & GENERATION_MASK)
-          >   tte[i].depth8 - ((GENERATION_CYCLE + generation8 -   tte[i].genBound8) & GENERATION_MASK))
+      if (replace_value(*replace) > replace_value(tte[i]))
           replace = &tte[i];
 
   return found = false, replace;
@@ -149,14 +723,358 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
 /// TranspositionTable::hashfull() returns an approximation of the hashtable
 /// occupation during a search. The hash is x permill full, as per UCI protocol.
 
-int TranspositionTable::hashfull() const {
+template<typename KeyType, int ClusterSize>
+int TranspositionTableT<KeyType, ClusterSize>::hashfull() const {
 
   int cnt = 0;
   for (int i = 0; i < 1000; ++i)
       for (int j = 0; j < ClusterSize; ++j)
-          cnt += table[i].entry[j].depth8 && (table[i].entry[j].genBound8 & GENERATION_MASK) == generation8;
+          cnt +=  table[i].epoch == epoch
+              &&  table[i].entry[j].depth8
+              && (table[i].entry[j].genBound8 & GENERATION_MASK) == generation8;
 
   return cnt / ClusterSize;
 }
 
+
+/// TranspositionTable::stats() returns the sum of the counters of the search
+/// threads, since the last 'ucinewgame', and the occupation of the whole table.
+/// Unlike hashfull(), all the clusters are scanned, in a multi-threaded way.
+
+template<typename KeyType, int ClusterSize>
+std::string TranspositionTableT<KeyType, ClusterSize>::stats() const {
+
+  Threads().main()->wait_for_search_finished();
+
+  TTStats s;
+  for (Thread* th : Threads())
+      s += th->ttStats;
+
+  std::vector<uint64_t> used(Options()["Threads"]), current(Options()["Threads"]);
+  std::vector<std::thread> threads;
+
+  Engine& engine = Engine::current();
+
+  for (size_t idx = 0; idx < Options()["Threads"]; ++idx)
+  {
+      threads.emplace_back([this, idx, &used, &current, &engine]() {
+
+          Engine::Scope scope(engine);
+
+          // Each thread will scan its part of the hash table
+          const size_t stride = size_t(clusterCount / Options()["Threads"]),
+                       start  = size_t(stride * idx),
+                       len    = idx != Options()["Threads"] - 1 ?
+                                stride : clusterCount - start;
+          uint64_t u = 0, c = 0;
+
+          for (size_t i = start; i < start + len; ++i)
+              for (int j = 0; j < ClusterSize && table[i].epoch == epoch; ++j)
+              {
+                  u += table[i].entry[j].depth8 != 0;
+                  c += table[i].entry[j].depth8 && (table[i].entry[j].genBound8 & GENERATION_MASK) == generation8;
+              }
+
+          used[idx] = u, current[idx] = c;
+      });
+  }
+
+  for (std::thread& th : threads)
+      th.join();
+
+  const double entries = double(clusterCount * ClusterSize);
+  const uint64_t totalUsed    = std::accumulate(used.begin(), used.end(), uint64_t(0));
+  const uint64_t totalCurrent = std::accumulate(current.begin(), current.end(), uint64_t(0));
+  const auto percent = [](double n, double total) { return 100.0 * n / std::max(total, 1.0); };
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2);
+
+  if (TTStatsEnabled)
+  {
+      ss << "\nProbes              : " << s.probes
+         << "\nHits                : " << s.hits << " (" << percent(s.hits, s.probes) << "%)"
+         << "\nEmpty slot hits     : " << s.emptyHits
+         << "\nSame key overwrites : " << s.sameKeyOverwrites
+         << "\nReplacements        :";
+
+      const char* classes[TTStats::DepthClasses] = { "qs", "1-4", "5-8", "9-12", "13+" };
+      for (int i = 0; i < TTStats::DepthClasses; ++i)
+          ss << " " << classes[i] << " " << s.replaced[i];
+
+      ss << "\nAge evictions       : " << s.ageEvictions
+         << "\nFalse matches       : " << s.falseMatches;
+  }
+  else
+      ss << "\nCounters            : not counted, build with ttstats=yes";
+
+  ss << "\nOccupancy           : " << percent(totalUsed, entries) << "% ("
+                                   << percent(totalCurrent, entries) << "% current generation)";
+
+  return ss.str();
+}
+
+
+/// TranspositionTable::stress() is a debugging tool that measures how often a
+/// probe returns an entry mixing the data of two positions. All the threads
+/// hammer a few clusters with keys of distinct low 16 bits, saving data derived
+/// from the key, so that any hit with inconsistent data is a torn entry. Data
+/// is read through a TTData after the probe, as done by the search. The table is
+/// cleared at the end.
+
+template<typename KeyType, int ClusterSize>
+void TranspositionTableT<KeyType, ClusterSize>::stress(size_t threadCount, TimePoint duration) {
+
+  Threads().main()->wait_for_search_finished();
+
+  // Do not trash the table of the other processes
+  if (shared)
+  {
+      sync_cout << "info string Stress test not available with a shared hash" << sync_endl;
+      return;
+  }
+
+  constexpr int Clusters = 64, KeysPerCluster = 16;
+
+  const uint64_t step = ~uint64_t(0) / clusterCount;
+  std::vector<Key> keys;
+  std::vector<uint64_t> probes(threadCount), hits(threadCount), torn(threadCount);
+  std::vector<std::thread> threads;
+  std::atomic<bool> stop(false);
+
+  for (int c = 0; c < Clusters; ++c)
+  {
+      const uint64_t base = (clusterCount / Clusters * c) * step + step / 2;
+
+      for (int i = 0; i < KeysPerCluster; ++i)
+          keys.push_back((base & ~uint64_t(0xFFFF)) | uint64_t(c * KeysPerCluster + i));
+  }
+
+  Engine& engine = Engine::current();
+  TimePoint elapsed = now();
+
+  for (size_t idx = 0; idx < threadCount; ++idx)
+  {
+      threads.emplace_back([&, idx]() {
+
+          Engine::Scope scope(engine);
+
+          PRNG rng(idx + 1);
+          TTStats unreported;
+          uint64_t n = 0, nHits = 0, nTorn = 0;
+
+          TTStats::bind(&unreported);
+
+          for ( ; (n & 1023) || !stop; ++n)
+          {
+              const Key key = keys[rng.rand<uint64_t>() % keys.size()];
+              const uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+              const Move  m  = Move(uint16_t(h >> 16) | 1);
+              const Value v  = Value(int16_t(h >> 32));
+              const Value ev = Value(int16_t(h >> 48));
+              const Depth d  = Depth(1 + (h >> 8) % 200);
+              const bool  pv = h & 1;
+              bool found;
+
+              Entry* tte = probe(key, found);
+              TTData data = *tte;
+
+              if (found && data.matches(key))
+              {
+                  ++nHits;
+                  nTorn +=   data.move()  != m
+                          || data.value() != v
+                          || data.eval()  != ev
+                          || data.depth() != d
+                          || data.is_pv() != pv;
+              }
+              else
+                  tte->save(key, v, pv, BOUND_EXACT, d, m, ev);
+          }
+
+          // Count locally, as counters in the shared vectors would false share
+          probes[idx] = n, hits[idx] = nHits, torn[idx] = nTorn;
+      });
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(duration));
+  stop = true;
+
+  for (std::thread& th : threads)
+      th.join();
+
+  elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  uint64_t totalProbes = 0, totalHits = 0, totalTorn = 0;
+  for (size_t idx = 0; idx < threadCount; ++idx)
+      totalProbes += probes[idx], totalHits += hits[idx], totalTorn += torn[idx];
+
+  clear();
+
+  sync_cout << "\n==========================="
+            << "\nThreads          : " << threadCount
+#if defined(TT_LOCKLESS)
+            << "\nEntries          : lockless"
+#else
+            << "\nEntries          : plain"
+#endif
+            << "\nTotal time (ms)  : " << elapsed
+            << "\nProbes           : " << totalProbes
+            << "\nHits             : " << totalHits
+            << "\nTorn hits        : " << totalTorn
+            << "\nTorn per million : " << totalTorn * 1000000 / std::max(totalHits, uint64_t(1))
+            << "\nProbes/second    : " << 1000 * totalProbes / elapsed << sync_endl;
+}
+
+
+/// QSearchTable::resize() sets the size of the table, measured in kilobytes,
+/// and clears it.
+
+void QSearchTable::resize(size_t kbSize) {
+
+  table.assign(kbSize * 1024 / sizeof(Cluster), Cluster());
+}
+
+
+/// QSearchTable::probe() looks up the position first in the small table, then in
+/// the global table. When both miss, it returns the entry of the small table to
+/// be replaced, chosen with the replacement strategy of the global table.
+
+TTEntry* QSearchTable::probe(const Key key, bool& found) {
+
+  TTEntry* const tte = table[mul_hi64(key, table.size())].entry;
+  const TTKey keyLow = (TTKey)key;
+
+  for (int i = 0; i < TTClusterSize; ++i)
+      if (tte[i].key() == keyLow && tte[i].depth8)
+          return found = true, &tte[i];
+
+  TTEntry* const globalTte = global.probe(key, found);
+
+  if (found)
+      return globalTte;
+
+  TTEntry* replace = tte;
+  for (int i = 1; i < TTClusterSize; ++i)
+      if (global.replace_value(*replace) > global.replace_value(tte[i]))
+          replace = &tte[i];
+
+  return replace;
+}
+
+
+/// TTLog::resize() sets the number of slots of the log, a power of two, and
+/// empties it.
+
+void TTLog::resize(size_t slots) {
+
+  table.assign(slots, Slot());
+  used.clear();
+}
+
+
+/// TTLog::probe() returns the entry of the position in the log. On the first
+/// probe of a position in the quantum, the entry is copied from the global table
+/// into the next free slot, found by linear probing. When the log is three
+/// quarters full, the global entry is copied into the scratch entry instead, so
+/// that the saves to it are lost but the search stays deterministic.
+
+TTEntry* TTLog::probe(const Key key, bool& found) {
+
+  const size_t mask = table.size() - 1;
+  size_t idx = key & mask;
+
+  for ( ; table[idx].key; idx = (idx + 1) & mask)
+      if (table[idx].key == key)
+      {
+          const TTEntry& e = table[idx].entry;
+          return found = e.depth8 && e.matches(key), &table[idx].entry;
+      }
+
+  TTEntry* const tte = TT().probe(key, found);
+  TTEntry* const copy = used.size() < table.size() / 4 * 3 ? &table[idx].entry : &scratch;
+
+  if (copy != &scratch)
+  {
+      table[idx].key = key;
+      used.push_back(idx);
+  }
+
+  *copy = found ? *tte : TTEntry();
+
+  return copy;
+}
+
+
+/// TTLog::flush() saves the entries of the log into the global table under the
+/// key of their slot, in the order of their first probe, and empties the log.
+
+void TTLog::flush() {
+
+  for (size_t idx : used)
+  {
+      Slot& slot = table[idx];
+      const TTEntry& e = slot.entry;
+
+      if (e.depth8 && e.matches(slot.key))
+      {
+          bool found;
+          TT().probe(slot.key, found)->save(slot.key, e.value(), e.is_pv(), e.bound(),
+                                            e.depth(), e.move(), e.eval());
+      }
+
+      slot = Slot();
+  }
+
+  used.clear();
+}
+
+
+/// PerftTable::resize() sets the size of the table, measured in megabytes. The
+/// entries are kept when the size does not change, as they stay valid from one
+/// perft to the next.
+
+void PerftTable::resize(size_t mbSize) {
+
+  const size_t count = mbSize * 1024 * 1024 / sizeof(Cluster);
+
+  if (count != table.size())
+      table.assign(count, Cluster());
+}
+
+
+/// PerftTable::probe() returns true and sets 'nodes' when the leaf count of the
+/// position at the given depth is stored in the table.
+
+bool PerftTable::probe(Key key, Depth depth, uint64_t& nodes) const {
+
+  for (const Entry& e : table[mul_hi64(key, table.size())].entry)
+  {
+      const uint64_t data = e.data;
+
+      if ((e.key ^ data) == key && (data & 0xFF) == uint64_t(depth))
+          return nodes = data >> 8, true;
+  }
+  return false;
+}
+
+
+/// PerftTable::save() stores a leaf count, in the first entry of the cluster if
+/// it is not deeper, otherwise in the second one.
+
+void PerftTable::save(Key key, Depth depth, uint64_t nodes) {
+
+  Cluster& c = table[mul_hi64(key, table.size())];
+  Entry& e = depth >= Depth(c.entry[0].data & 0xFF) ? c.entry[0] : c.entry[1];
+  const uint64_t data = nodes << 8 | uint64_t(depth);
+
+  e.data = data;
+  e.key = key ^ data;
+}
+
+
+// Only the geometry selected in tt.h is compiled
+template struct TTEntryT<TTKey>;
+template class TranspositionTableT<TTKey, TTClusterSize>;
+
 } // namespace Stockfish
@@ -19,14 +19,17 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <string>
+#include <vector>
+
 #include "misc.h"
 #include "types.h"
 
 namespace Stockfish {
 
-/// TTEntry struct is the 10 bytes transposition table entry, defined as below:
+/// TTEntry struct is the transposition table entry, defined as below:
 ///
-/// key        16 bit
+/// key        16 or 32 bit (KeyType)
 /// depth       8 bit
 /// generation  5 bit
 /// pv node     1 bit
@@ -34,8 +37,18 @@ namespace Stockfish {
 /// move       16 bit
 /// value      16 bit
 /// eval value 16 bit
+///
+/// Entries are written without any lock, so that with many threads a reader can
+/// see an entry whose fields come from two different saves. When compiled with
+/// TT_LOCKLESS, the key is stored xored with a checksum of the other fields, and
+/// such a torn entry is very unlikely to match the key of the position probed,
+/// see TTData below.
 
-struct TTEntry {
+class QSearchTable;
+class TTLog;
+
+template<typename KeyType>
+struct TTEntryT {
 
   Move  move()  const { return (Move )move16; }
   Value value() const { return (Value)value16; }
@@ -44,11 +57,23 @@ struct TTEntry {
   bool is_pv()  const { return (bool)(genBound8 & 0x4); }
   Bound bound() const { return (Bound)(genBound8 & 0x3); }
   void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
+  bool matches(Key k) const { return key() == (KeyType)k; }
 
 private:
-  friend class TranspositionTable;
+  template<typename, int> friend class TranspositionTableT;
+  friend class QSearchTable;
+  friend class TTLog;
+
+#if defined(TT_LOCKLESS)
+  uint16_t checksum() const { return uint16_t(move16 ^ value16 ^ eval16 ^ (depth8 | (genBound8 & 0x7) << 8)); }
+  KeyType key() const { return KeyType(keyLow ^ checksum()); }
+  void seal(KeyType k) { keyLow = KeyType(k ^ checksum()); }
+#else
+  KeyType key() const { return keyLow; }
+  void seal(KeyType k) { keyLow = k; }
+#endif
 
-  uint16_t key16;
+  KeyType  keyLow; // Low bits of the position key
   uint8_t  depth8;
   uint8_t  genBound8;
   uint16_t move16;
@@ -57,22 +82,67 @@ private:
 };
 
 
+/// TTStats struct keeps the transposition table counters of one search thread.
+/// Every thread binds its own instance in idle_loop(), so that the counters
+/// are updated without any synchronisation. Replacements are counted by the
+/// depth of the replaced entry: qsearch, 1-4, 5-8, 9-12 and 13 or more. The
+/// counters are only updated in builds with TT_STATS, as they cost some work
+/// on every probe and save.
+
+#if defined(TT_STATS)
+constexpr bool TTStatsEnabled = true;
+#else
+constexpr bool TTStatsEnabled = false;
+#endif
+
+struct TTStats {
+
+  static constexpr int DepthClasses = 5;
+
+  static void bind(TTStats* s);
+  static int depth_class(Depth d) { return d <= 0 ? 0 : std::min((d + 3) / 4, DepthClasses - 1); }
+
+  TTStats& operator+=(const TTStats& s) {
+    probes += s.probes, hits += s.hits, emptyHits += s.emptyHits;
+    sameKeyOverwrites += s.sameKeyOverwrites, ageEvictions += s.ageEvictions;
+    falseMatches += s.falseMatches;
+    for (int i = 0; i < DepthClasses; ++i)
+        replaced[i] += s.replaced[i];
+    return *this;
+  }
+
+  uint64_t probes = 0, hits = 0, emptyHits = 0;
+  uint64_t sameKeyOverwrites = 0, ageEvictions = 0, falseMatches = 0;
+  uint64_t replaced[DepthClasses] = {};
+};
+
+
 /// A TranspositionTable is an array of Cluster, of size clusterCount. Each
 /// cluster consists of ClusterSize number of TTEntry. Each non-empty TTEntry
 /// contains information on exactly one position. The size of a Cluster should
 /// divide the size of a cache line for best performance, as the cacheline is
-/// prefetched when possible.
+/// prefetched when possible. The geometry of the cluster is selected at compile
+/// time, see below: wider keys give fewer false matches, bigger clusters fewer
+/// probe misses, at the price of fewer entries for a given hash size.
 
-class TranspositionTable {
+template<typename KeyType, int ClusterSize>
+class TranspositionTableT {
+
+public:
+  typedef TTEntryT<KeyType> Entry;
 
-  static constexpr int ClusterSize = 3;
+private:
+  static constexpr size_t EntriesSize = ClusterSize * sizeof(Entry) + sizeof(uint16_t);
+  static constexpr size_t ClusterBytes = EntriesSize <= 32 ? 32 : 64;
 
-  struct Cluster {
-    TTEntry entry[ClusterSize];
-    char padding[2]; // Pad to 32 bytes
+  // Padded to 32 or 64 bytes by the alignment
+  struct alignas(ClusterBytes) Cluster {
+    Entry entry[ClusterSize];
+    uint16_t epoch; // Entries are empty if not equal to the table epoch, see clear()
   };
 
-  static_assert(sizeof(Cluster) == 32, "Unexpected Cluster size");
+  static_assert(EntriesSize <= ClusterBytes, "Cluster does not fit in a cache line");
+  static_assert(sizeof(Cluster) == ClusterBytes, "Unexpected Cluster size");
 
   // Constants used to refresh the hash table periodically
   static constexpr unsigned GENERATION_BITS  = 3;                                // nb of bits reserved for other things
@@ -81,26 +151,171 @@ class TranspositionTable {
   static constexpr int      GENERATION_MASK  = (0xFF << GENERATION_BITS) & 0xFF; // mask to pull out generation number
 
 public:
- ~TranspositionTable() { aligned_large_pages_free(table); }
+ ~TranspositionTableT() { release(); }
   void new_search() { generation8 += GENERATION_DELTA; } // Lower bits are used for other things
-  TTEntry* probe(const Key key, bool& found) const;
+  Entry* probe(const Key key, bool& found) const;
   int hashfull() const;
+  std::string stats() const;
   void resize(size_t mbSize);
   void clear();
+  static bool unlink_shared(const std::string& name);
+  bool save(const std::string& fname) const;
+  bool load(const std::string& fname);
+  void stress(size_t threadCount, TimePoint duration);
 
-  TTEntry* first_entry(const Key key) const {
+  Entry* first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
   }
 
 private:
-  friend struct TTEntry;
+  friend Entry;
+  friend class QSearchTable;
+
+  void release();
+  void zero();
+  void rehash(const Cluster* oldTable, size_t oldCount);
+  void renumber(size_t start, size_t len, uint16_t fileEpoch);
+
+  // Due to our packed storage format for generation and its cyclic
+  // nature we add GENERATION_CYCLE (256 is the modulus, plus what
+  // is needed to keep the unrelated lowest n bits from affecting
+  // the result) to calculate the entry age correctly even after
+  // generation8 overflows into the next cycle.
+  int replace_value(const Entry& e) const {
+    return e.depth8 - ((GENERATION_CYCLE + generation8 - e.genBound8) & GENERATION_MASK);
+  }
+
+  size_t clusterCount = 0;
+  Cluster* table = nullptr;
+  bool shared = false; // Table is in a shared memory segment, see resize()
+  std::string segmentName; // Name of the shared memory segment
+  uint16_t epoch = 0;  // Incremented by clear()
+  uint8_t generation8 = 0; // Size must be not bigger than TTEntry::genBound8
+};
+
+/// Cluster geometry, chosen with 'make cluster=...':
+///
+/// 32       3 entries with 16 bit keys, 32 bytes (default)
+/// 64       6 entries with 16 bit keys, 64 bytes
+/// 64wide   5 entries with 32 bit keys, 64 bytes
+
+#if defined(TT_CLUSTER_64)
+typedef uint16_t TTKey;
+constexpr int TTClusterSize = 6;
+#elif defined(TT_CLUSTER_64_WIDE)
+typedef uint32_t TTKey;
+constexpr int TTClusterSize = 5;
+#else
+typedef uint16_t TTKey;
+constexpr int TTClusterSize = 3;
+#endif
+
+typedef TranspositionTableT<TTKey, TTClusterSize> TranspositionTable;
+
+typedef TranspositionTable::Entry TTEntry;
+
+/// TTData is what the search reads of a probed entry. With TT_LOCKLESS it is a
+/// copy of the entry, taken once and checked against the key with matches(), so
+/// that all its fields come from the same save even if the entry is written
+/// again later. Otherwise it is the entry itself, read when the fields are used.
+
+#if defined(TT_LOCKLESS)
+typedef const TTEntry TTData;
+#else
+typedef const TTEntry& TTData;
+#endif
+
+
+/// QSearchTable is a small table owned by a search thread, sized to stay in the
+/// L2 cache, that sits in front of the global table in qsearch(). A position is
+/// looked up in the small table first, then in the global one, and new qsearch
+/// entries are stored in the small table only, so that they do not evict the
+/// deeper entries of the main search. Disabled when its size is zero.
+
+class QSearchTable {
+
+  static constexpr size_t ClusterBytes = TTClusterSize * sizeof(TTEntry) <= 32 ? 32 : 64;
+
+  struct alignas(ClusterBytes) Cluster {
+    TTEntry entry[TTClusterSize];
+  };
+
+public:
+  explicit QSearchTable(const TranspositionTable& tt) : global(tt) {}
+  bool enabled() const { return !table.empty(); }
+  void resize(size_t kbSize);
+  TTEntry* probe(const Key key, bool& found);
+
+  // Prefetch the clusters that probe() reads: the one of the small table, if
+  // enabled, and the one of the global table, where its misses are looked up.
+  void prefetch(const Key key) const {
+    if (enabled())
+        Stockfish::prefetch(const_cast<Cluster*>(&table[mul_hi64(key, table.size())]));
+
+    Stockfish::prefetch(global.first_entry(key));
+  }
+
+private:
+  const TranspositionTable& global;
+  std::vector<Cluster> table;
+};
+
+
+/// TTLog is the write buffer of a thread in the deterministic search mode. The
+/// global table is only read during a quantum of nodes: a probed entry is copied
+/// into the log of the thread and written there, and the logs of all threads are
+/// flushed into the global table in thread order at the end of the quantum, so
+/// that its content does not depend on the timing of the threads. A slot is never
+/// given to another position within a quantum, as a node may still write to it.
+/// Disabled when its size is zero.
+
+class TTLog {
+
+  struct Slot {
+    Key key;
+    TTEntry entry;
+  };
 
-  size_t clusterCount;
-  Cluster* table;
-  uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+public:
+  static constexpr size_t Slots = 16384;
+
+  bool enabled() const { return !table.empty(); }
+  void resize(size_t slots);
+  TTEntry* probe(const Key key, bool& found);
+  void flush();
+
+private:
+  std::vector<Slot> table;
+  std::vector<size_t> used;
+  TTEntry scratch; // Returned when the log is full, its saves are dropped
 };
 
-extern TranspositionTable TT;
+
+/// PerftTable caches the leaf counts of the subtrees met by perft, indexed by
+/// position key and depth, and is shared by all the threads of the pool. The
+/// key is stored xored with the data word, so that an entry torn by concurrent
+/// saves does not match. Disabled when its size is zero.
+
+class PerftTable {
+
+  struct Entry {
+    uint64_t key;
+    uint64_t data; // Leaf count << 8 | depth
+  };
+
+  struct alignas(32) Cluster {
+    Entry entry[2]; // Depth-preferred, then always-replace
+  };
+
+public:
+  bool enabled() const { return !table.empty(); }
+  void resize(size_t mbSize);
+  bool probe(Key key, Depth depth, uint64_t& nodes) const;
+  void save(Key key, Depth depth, uint64_t nodes);
+
+private:
+  std::vector<Cluster> table;
+};
 
 } // namespace Stockfish
 
@@ -16,12 +16,19 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 
+#include "engine.h"
 #include "evaluate.h"
 #include "movegen.h"
 #include "position.h"
@@ -68,7 +75,7 @@ namespace {
         return;
 
     states = StateListPtr(new std::deque<StateInfo>(1)); // Drop old and create a new one
-    pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
+    pos.set(fen, Options()["UCI_Chess960"], &states->back(), Threads().main());
 
     // Parse move list (if any)
     while (is >> token && (m = UCI::to_move(pos, token)) != MOVE_NONE)
@@ -85,7 +92,7 @@ namespace {
 
     StateListPtr states(new std::deque<StateInfo>(1));
     Position p;
-    p.set(pos.fen(), Options["UCI_Chess960"], &states->back(), Threads.main());
+    p.set(pos.fen(), Options()["UCI_Chess960"], &states->back(), Threads().main());
 
     Eval::NNUE::verify();
 
@@ -110,8 +117,8 @@ namespace {
     while (is >> token)
         value += (value.empty() ? "" : " ") + token;
 
-    if (Options.count(name))
-        Options[name] = value;
+    if (Options().count(name))
+        Options()[name] = value;
     else
         sync_cout << "No such option: " << name << sync_endl;
   }
@@ -128,6 +135,7 @@ namespace {
     bool ponderMode = false;
 
     limits.startTime = now(); // As early as possible!
+    Time().latency.go_received();
 
     while (is >> token)
         if (token == "searchmoves") // Needs to be the last command on the line
@@ -147,23 +155,24 @@ namespace {
         else if (token == "infinite")  limits.infinite = 1;
         else if (token == "ponder")    ponderMode = true;
 
-    Threads.start_thinking(pos, states, limits, ponderMode);
+    Threads().start_thinking(pos, states, limits, ponderMode);
   }
 
 
-  // bench() is called when engine receives the "bench" command. Firstly
-  // a list of UCI commands is setup according to bench parameters, then
-  // it is run one by one printing a summary at the end.
+  // run_bench() runs one by one the UCI commands of a list made by setup_bench(),
+  // and returns the number of nodes searched, the time spent and the sum of the
+  // search statistics.
 
-  void bench(Position& pos, istream& args, StateListPtr& states) {
+  uint64_t run_bench(Position& pos, const vector<string>& list, StateListPtr& states,
+                     TimePoint& elapsed, SearchStats& stats) {
 
     string token;
     uint64_t num, nodes = 0, cnt = 1;
 
-    vector<string> list = setup_bench(pos, args);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0 || s.find("eval") == 0; });
 
-    TimePoint elapsed = now();
+    elapsed = now();
+    stats = SearchStats();
 
     for (const auto& cmd : list)
     {
@@ -176,8 +185,9 @@ namespace {
             if (token == "go")
             {
                go(pos, is, states);
-               Threads.main()->wait_for_search_finished();
-               nodes += Threads.nodes_searched();
+               Threads().main()->wait_for_search_finished();
+               nodes += Threads().nodes_searched();
+               stats += Threads().search_stats();
             }
             else
                trace_eval(pos);
@@ -189,14 +199,177 @@ namespace {
 
     elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
 
+    return nodes;
+  }
+
+
+  // bench() is called when engine receives the "bench" command. Firstly
+  // a list of UCI commands is setup according to bench parameters, then
+  // it is run one by one printing a summary at the end.
+
+  void bench(Position& pos, istream& args, StateListPtr& states) {
+
+    TimePoint elapsed;
+    SearchStats stats;
+    vector<string> list = setup_bench(pos, args);
+    uint64_t nodes = run_bench(pos, list, states, elapsed, stats);
+
     dbg_print(); // Just before exiting
 
     cerr << "\n==========================="
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+    cerr << "\nHash statistics" << TT().stats() << endl;
+
+    cerr << "\nSearch statistics\n" << stats << endl;
+  }
+
+  // scaling() is called when engine receives the "scaling" command. It searches
+  // the default bench positions to a fixed depth with 1, 2, 4... threads up to
+  // the given count, once in each SMP mode, and reports the time to depth and
+  // the speedup over one thread.
+
+  void scaling(Position& pos, istringstream& is, StateListPtr& states) {
+
+    string maxThreads = "8", depth = "13", ttSize = "64", evalType = "mixed";
+    // The benches set these options, restore them when done
+    string mode = string(Options()["SMP Mode"]);
+    string threadsOption = to_string(size_t(Options()["Threads"])),
+           hashOption    = to_string(size_t(Options()["Hash"]));
+    ostringstream report;
+    TimePoint elapsed, baseTime = 0;
+    SearchStats stats;
+
+    is >> maxThreads >> depth >> ttSize >> evalType;
+
+    for (const char* smpMode : { "lazy", "abdada" })
+        for (int threads = 1; threads <= stoi(maxThreads); threads *= 2)
+        {
+            istringstream args(ttSize + " " + to_string(threads) + " " + depth + " default depth " + evalType);
+            vector<string> list = setup_bench(pos, args);
+            list.insert(list.begin(), string("setoption name SMP Mode value ") + smpMode);
+
+            uint64_t nodes = run_bench(pos, list, states, elapsed, stats);
+
+            if (threads == 1)
+                baseTime = elapsed;
+
+            report << "\n" << setw(6) << smpMode << setw(8) << threads << setw(12) << elapsed
+                   << setw(14) << nodes << setw(12) << 1000 * nodes / elapsed
+                   << setw(9) << fixed << setprecision(2) << double(baseTime) / elapsed;
+        }
+
+    Options()["SMP Mode"] = mode;
+    Options()["Threads"] = threadsOption;
+    Options()["Hash"] = hashOption;
+
+    cerr << "\n==========================="
+         << "\n" << setw(6) << "mode" << setw(8) << "threads" << setw(12) << "time (ms)"
+         << setw(14) << "nodes" << setw(12) << "nodes/sec" << setw(9) << "speedup"
+         << report.str() << endl;
   }
 
+  // latency() is called when engine receives the "latency" command. It starts
+  // the given number of infinite searches of the current position, and stops
+  // each of them as soon as it sends its first info line. The delays from 'go'
+  // to the first info line and from 'stop' to bestmove are then reported.
+
+  void latency(Position& pos, istringstream& is, StateListPtr& states) {
+
+    using Clock = std::chrono::steady_clock;
+
+    int runs = 100;
+    Engine& engine = Engine::current();
+    auto onInfo = engine.onInfo;
+    auto onBestMove = engine.onBestMove;
+    std::atomic<bool> infoSent;
+    Clock::time_point bestMoveTime;
+    vector<int64_t> goDelays, stopDelays;
+
+    is >> runs;
+
+    engine.onInfo = [&](const vector<Search::InfoLine>&) { infoSent = true; };
+    engine.onBestMove = [&](Move, Move) { bestMoveTime = Clock::now(); };
+
+    for (int i = 0; i < runs; ++i)
+    {
+        Search::LimitsType limits;
+        limits.startTime = now();
+        limits.infinite = 1;
+        infoSent = false;
+
+        Clock::time_point start = Clock::now();
+        Threads().start_thinking(pos, states, limits);
+
+        while (!infoSent)
+            std::this_thread::yield();
+
+        Clock::time_point stop = Clock::now();
+        Threads().stop = true;
+        Threads().main()->wait_for_search_finished();
+
+        goDelays.push_back(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count());
+        stopDelays.push_back(std::chrono::duration_cast<std::chrono::microseconds>(bestMoveTime - stop).count());
+    }
+
+    engine.onInfo = onInfo;
+    engine.onBestMove = onBestMove;
+
+    auto report = [&](const char* name, vector<int64_t>& delays) {
+        sort(delays.begin(), delays.end());
+        sync_cout << "info string latency " << name
+                  << " median " << delays[delays.size() / 2]
+                  << " p95 " << delays[delays.size() * 95 / 100]
+                  << " max " << delays.back() << " us" << sync_endl;
+    };
+
+    if (runs > 0)
+    {
+        report("go-info", goDelays);
+        report("stop-bestmove", stopDelays);
+    }
+  }
+
+
+  // analyze() is called when engine receives the "analyze" command. It reads
+  // one FEN per line from the given file and starts the batch analysis of all
+  // of them, each position being searched up to the given depth or nodes.
+
+  void analyze(istringstream& is) {
+
+    Search::LimitsType limits;
+    string fenFile, token, fen;
+    vector<string> fens;
+
+    limits.startTime = now();
+
+    is >> fenFile >> token;
+    if (token == "depth")      is >> limits.depth;
+    else if (token == "nodes") is >> limits.nodes;
+
+    if (!limits.depth && !limits.nodes)
+    {
+        sync_cout << "info string analyze needs a 'depth' or 'nodes' limit" << sync_endl;
+        return;
+    }
+
+    ifstream file(fenFile);
+    if (!file.is_open())
+    {
+        sync_cout << "info string Unable to open file " << fenFile << sync_endl;
+        return;
+    }
+
+    while (getline(file, fen))
+        if (!fen.empty() && fen[0] != '#')
+            fens.push_back(fen);
+
+    Threads().start_analysis(fens, limits, Options()["UCI_Chess960"]);
+  }
+
+
   // The win rate model returns the probability (per mille) of winning given an eval
   // and a game-ply. The model fits rather accurately the LTC fishtest statistics.
   int win_rate_model(Value v, int ply) {
@@ -222,19 +395,108 @@ namespace {
 } // namespace
 
 
+/// UCI::execute() processes a single command, sent by the GUI or given on the
+/// command line, on the current engine. It returns the command name so that
+/// the caller can stop on 'quit'. In addition to the UCI ones, also some
+/// additional debug commands are supported.
+
+string UCI::execute(const string& cmd) {
+
+  Position& pos = Engine::current().pos;
+  StateListPtr& states = Engine::current().states;
+  string token;
+
+  istringstream is(cmd);
+
+  is >> skipws >> token;
+
+  if (    token == "quit"
+      ||  token == "stop")
+      Threads().stop = true;
+
+  // The GUI sends 'ponderhit' to tell us the user has played the expected move.
+  // So 'ponderhit' will be sent if we were told to ponder on the same move the
+  // user has played. We should continue searching but switch from pondering to
+  // normal search.
+  else if (token == "ponderhit")
+      Threads().main()->ponder = false; // Switch to normal search
+
+  else if (token == "uci")
+      sync_cout << "id name " << engine_info(true)
+                << "\n"       << Options()
+                << "\nuciok"  << sync_endl;
+
+  else if (token == "setoption")  setoption(is);
+  else if (token == "go")         go(pos, is, states);
+  else if (token == "position")   position(pos, is, states);
+  else if (token == "ucinewgame") Search::clear();
+  else if (token == "isready")    sync_cout << "readyok" << sync_endl;
+
+  // Additional custom non-UCI commands, mainly for debugging.
+  // Do not use these commands during a search!
+  else if (token == "flip")     pos.flip();
+  else if (token == "bench")    bench(pos, is, states);
+  else if (token == "scaling")  scaling(pos, is, states);
+  else if (token == "latency")  latency(pos, is, states);
+  else if (token == "analyze")  analyze(is);
+  else if (token == "d")        sync_cout << pos << sync_endl;
+  else if (token == "eval")     trace_eval(pos);
+  else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+  else if (token == "tt")
+  {
+      string action, fname = string(Options()["Hash File"]);
+      is >> skipws >> action >> fname;
+
+      if (action == "save")
+      {
+          bool saved = TT().save(fname);
+          sync_cout << (saved ? "Hash saved successfully to "
+                              : "Failed to save hash to ") << fname << sync_endl;
+      }
+      else if (action == "load")
+      {
+          bool loaded = TT().load(fname);
+          sync_cout << (loaded ? "Hash loaded successfully from "
+                               : "Failed to load hash from ") << fname << sync_endl;
+      }
+      else
+          sync_cout << "Unknown command: " << cmd << sync_endl;
+  }
+  else if (token == "ttstats")
+  {
+      string stats = TT().stats();
+      sync_cout << stats.substr(1) << sync_endl;
+  }
+  else if (token == "ttstress")
+  {
+      size_t threads = Options()["Threads"];
+      TimePoint duration = 5000;
+      is >> threads >> duration;
+      TT().stress(std::max(threads, size_t(1)), duration);
+  }
+  else if (token == "export_net")
+  {
+      std::optional<std::string> filename;
+      std::string f;
+      if (is >> skipws >> f)
+          filename = f;
+      Eval::NNUE::save_eval(filename);
+  }
+  else if (!token.empty() && token[0] != '#')
+      sync_cout << "Unknown command: " << cmd << sync_endl;
+
+  return token;
+}
+
+
 /// UCI::loop() waits for a command from stdin, parses it and calls the appropriate
 /// function. Also intercepts EOF from stdin to ensure gracefully exiting if the
 /// GUI dies unexpectedly. When called with some command line arguments, e.g. to
 /// run 'bench', once the command is executed the function returns immediately.
-/// In addition to the UCI ones, also some additional debug commands are supported.
 
 void UCI::loop(int argc, char* argv[]) {
 
-  Position pos;
   string token, cmd;
-  StateListPtr states(new std::deque<StateInfo>(1));
-
-  pos.set(StartFEN, false, &states->back(), Threads.main());
 
   for (int i = 1; i < argc; ++i)
       cmd += std::string(argv[i]) + " ";
@@ -243,51 +505,9 @@ void UCI::loop(int argc, char* argv[]) {
       if (argc == 1 && !getline(cin, cmd)) // Block here waiting for input or EOF
           cmd = "quit";
 
-      istringstream is(cmd);
-
-      token.clear(); // Avoid a stale if getline() returns empty or blank line
-      is >> skipws >> token;
-
-      if (    token == "quit"
-          ||  token == "stop")
-          Threads.stop = true;
-
-      // The GUI sends 'ponderhit' to tell us the user has played the expected move.
-      // So 'ponderhit' will be sent if we were told to ponder on the same move the
-      // user has played. We should continue searching but switch from pondering to
-      // normal search.
-      else if (token == "ponderhit")
-          Threads.main()->ponder = false; // Switch to normal search
-
-      else if (token == "uci")
-          sync_cout << "id name " << engine_info(true)
-                    << "\n"       << Options
-                    << "\nuciok"  << sync_endl;
-
-      else if (token == "setoption")  setoption(is);
-      else if (token == "go")         go(pos, is, states);
-      else if (token == "position")   position(pos, is, states);
-      else if (token == "ucinewgame") Search::clear();
-      else if (token == "isready")    sync_cout << "readyok" << sync_endl;
-
-      // Additional custom non-UCI commands, mainly for debugging.
-      // Do not use these commands during a search!
-      else if (token == "flip")     pos.flip();
-      else if (token == "bench")    bench(pos, is, states);
-      else if (token == "d")        sync_cout << pos << sync_endl;
-      else if (token == "eval")     trace_eval(pos);
-      else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
-      else if (token == "export_net")
-      {
-          std::optional<std::string> filename;
-          std::string f;
-          if (is >> skipws >> f)
-              filename = f;
-          Eval::NNUE::save_eval(filename);
-      }
-      else if (!token.empty() && token[0] != '#')
-          sync_cout << "Unknown command: " << cmd << sync_endl;
+      Time().latency.command_received();
 
+      token = execute(cmd);
   } while (token != "quit" && argc == 1); // Command line args are one-shot
 }
 
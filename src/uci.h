@@ -53,6 +53,7 @@ public:
   Option(const char* v, const char* cur, OnChange = nullptr);
 
   Option& operator=(const std::string&);
+  bool accepts(const std::string&) const;
   void operator<<(const Option&);
   operator double() const;
   operator std::string() const;
@@ -69,6 +70,7 @@ private:
 
 void init(OptionsMap&);
 void loop(int argc, char* argv[]);
+std::string execute(const std::string& cmd);
 std::string value(Value v);
 std::string square(Square s);
 std::string move(Move m, bool chess960);
@@ -78,8 +80,6 @@ Move to_move(const Position& pos, std::string& str);
 
 } // namespace UCI
 
-extern UCI::OptionsMap Options;
-
 } // namespace Stockfish
 
 #endif // #ifndef UCI_H_INCLUDED
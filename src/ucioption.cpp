@@ -17,10 +17,15 @@
 */
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdlib>
+#include <iostream>
 #include <ostream>
 #include <sstream>
+#include <vector>
 
+#include "engine.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "search.h"
@@ -33,15 +38,30 @@ using std::string;
 
 namespace Stockfish {
 
-UCI::OptionsMap Options; // Global object
-
 namespace UCI {
 
 /// 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
-void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
+void on_hash_size(const Option& o) { TT().resize(size_t(o)); }
+void on_hash_shared(const Option& ) { TT().resize(size_t(Options()["Hash"])); }
+void on_hash_unlink(const Option&) {
+  const string name = Options()["Hash Shared Name"];
+  if (!TT().unlink_shared(name))
+      sync_cout << "info string No shared hash " << name << " to remove" << sync_endl;
+}
+void on_qsearch_hash(const Option& o) {
+  Threads().main()->wait_for_search_finished();
+  for (Thread* th : Threads())
+      th->qsTable.resize(size_t(o));
+}
+void on_huge_pages(const Option& ) { TT().resize(size_t(Options()["Hash"])); }
+void on_hash_file(const Option& o) {
+  if (string(o) != "<empty>" && !TT().load(o))
+      sync_cout << "info string Failed to load hash from " << string(o) << sync_endl;
+}
 void on_logger(const Option& o) { start_logger(o); }
-void on_threads(const Option& o) { Threads.set(size_t(o)); }
+void on_threads(const Option& o) { Threads().set(size_t(o)); }
+void on_numa_policy(const Option& ) { Threads().set(size_t(Options()["Threads"])); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
 void on_use_NNUE(const Option& ) { Eval::NNUE::init(); }
 void on_eval_file(const Option& ) { Eval::NNUE::init(); }
@@ -62,19 +82,36 @@ void init(OptionsMap& o) {
 
   o["Debug Log File"]        << Option("", on_logger);
   o["Threads"]               << Option(1, 1, 512, on_threads);
+  o["Thread Spin"]           << Option(0, 0, 1000000);
+  o["SMP Mode"]              << Option("lazy var lazy var abdada", "lazy");
+  o["Deterministic"]         << Option(false);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["QSearch Hash"]          << Option(0, 0, 65536, on_qsearch_hash);
+  o["QSearch Prefetch"]      << Option(false);
+  o["Perft Hash"]            << Option(0, 0, MaxHashMB);
+  o["Hash File"]             << Option("<empty>", on_hash_file);
+  o["Hash Shared Name"]      << Option("<empty>", on_hash_shared);
+  o["Hash Shared Unlink"]    << Option(on_hash_unlink);
+  o["Rehash On Resize"]      << Option(false);
+  o["Huge Pages"]            << Option("default var default var 2MB var 1GB", "default", on_huge_pages);
+  o["NUMA Policy"]           << Option("none var none var interleave var partition", "none", on_numa_policy);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
+  o["MultiPV Split"]         << Option(false);
   o["Skill Level"]           << Option(20, 0, 20);
   o["Move Overhead"]         << Option(10, 0, 5000);
   o["Slow Mover"]            << Option(100, 10, 1000);
+  o["Adaptive Time"]         << Option(false);
+  o["Time Log File"]         << Option("<empty>");
+  o["Search Reuse"]          << Option(false);
   o["nodestime"]             << Option(0, 0, 10000);
   o["UCI_Chess960"]          << Option(false);
   o["UCI_AnalyseMode"]       << Option(false);
   o["UCI_LimitStrength"]     << Option(false);
   o["UCI_Elo"]               << Option(1350, 1350, 2850);
   o["UCI_ShowWDL"]           << Option(false);
+  o["Search Stats"]          << Option(false);
   o["SyzygyPath"]            << Option("<empty>", on_tb_path);
   o["SyzygyProbeDepth"]      << Option(1, 1, 100);
   o["Syzygy50MoveRule"]      << Option(true);
@@ -86,26 +123,33 @@ void init(OptionsMap& o) {
 
 /// operator<<() is used to print all the options default values in chronological
 /// insertion order (the idx field) and in the format defined by the UCI protocol.
+/// The insertion counter is shared by the options of all the engines, so the
+/// indices of one map are increasing but not necessarily contiguous.
 
 std::ostream& operator<<(std::ostream& os, const OptionsMap& om) {
 
-  for (size_t idx = 0; idx < om.size(); ++idx)
-      for (const auto& it : om)
-          if (it.second.idx == idx)
-          {
-              const Option& o = it.second;
-              os << "\noption name " << it.first << " type " << o.type;
+  std::vector<OptionsMap::const_iterator> sorted;
 
-              if (o.type == "string" || o.type == "check" || o.type == "combo")
-                  os << " default " << o.defaultValue;
+  for (auto it = om.begin(); it != om.end(); ++it)
+      sorted.push_back(it);
 
-              if (o.type == "spin")
-                  os << " default " << int(stof(o.defaultValue))
-                     << " min "     << o.min
-                     << " max "     << o.max;
+  std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+      return a->second.idx < b->second.idx;
+  });
 
-              break;
-          }
+  for (const auto& it : sorted)
+  {
+      const Option& o = it->second;
+      os << "\noption name " << it->first << " type " << o.type;
+
+      if (o.type == "string" || o.type == "check" || o.type == "combo")
+          os << " default " << o.defaultValue;
+
+      if (o.type == "spin")
+          os << " default " << int(stof(o.defaultValue))
+             << " min "     << o.min
+             << " max "     << o.max;
+  }
 
   return os;
 }
@@ -149,25 +193,32 @@ bool Option::operator==(const char* s) const {
 
 void Option::operator<<(const Option& o) {
 
-  static size_t insert_order = 0;
+  static std::atomic<size_t> insert_order;
 
   *this = o;
   idx = insert_order++;
 }
 
 
-/// operator=() updates currentValue and triggers on_change() action. It's up to
-/// the GUI to check for option's limits, but we could receive the new value
-/// from the user by console window, so let's check the bounds anyway.
+/// accepts() checks that a value is valid for the option: a number within the
+/// bounds for a spin, true or false for a check, and one of the listed values for
+/// a combo. Any value is accepted for a button.
 
-Option& Option::operator=(const string& v) {
+bool Option::accepts(const string& v) const {
 
-  assert(!type.empty());
+  if (type == "button")
+      return true;
 
-  if (   (type != "button" && v.empty())
-      || (type == "check" && v != "true" && v != "false")
-      || (type == "spin" && (stof(v) < min || stof(v) > max)))
-      return *this;
+  if (   v.empty()
+      || (type == "check" && v != "true" && v != "false"))
+      return false;
+
+  if (type == "spin")
+  {
+      char* end;
+      double d = std::strtod(v.c_str(), &end);
+      return *end == '\0' && d >= min && d <= max;
+  }
 
   if (type == "combo")
   {
@@ -176,10 +227,24 @@ Option& Option::operator=(const string& v) {
       std::istringstream ss(defaultValue);
       while (ss >> token)
           comboMap[token] << Option();
-      if (!comboMap.count(v) || v == "var")
-          return *this;
+      return comboMap.count(v) && v != "var";
   }
 
+  return true;
+}
+
+
+/// operator=() updates currentValue and triggers on_change() action. It's up to
+/// the GUI to check for option's limits, but we could receive the new value
+/// from the user by console window, so let's check the bounds anyway.
+
+Option& Option::operator=(const string& v) {
+
+  assert(!type.empty());
+
+  if (!accepts(v))
+      return *this;
+
   if (type != "button")
       currentValue = v;
 
@@ -50,6 +50,11 @@ race:Stockfish::TTEntry::is_pv
 race:Stockfish::TranspositionTable::probe
 race:Stockfish::TranspositionTable::hashfull
 
+race:Stockfish::TTEntryT*
+race:Stockfish::TranspositionTableT*::probe
+race:Stockfish::TranspositionTableT*::hashfull
+race:Stockfish::TranspositionTableT*::stress
+
 EOF
 
     export TSAN_OPTIONS="suppressions=./tsan.supp"
@@ -78,6 +83,14 @@ do
 
 done
 
+# positions and hash file for the debugging commands
+cat << EOF > analyze.epd
+rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1
+5rk1/1K4p1/8/8/3B4/8/8/8 b - - 0 1
+EOF
+
+hashfile=$(mktemp)
+
 # more general testing, following an uci protocol exchange
 cat << EOF > game.exp
  set timeout 240
@@ -101,6 +114,24 @@ cat << EOF > game.exp
  send "go depth 10\n"
  expect "bestmove"
 
+ send "ttstats\n"
+ expect "Occupancy"
+
+ send "tt save $hashfile\n"
+ expect "Hash saved successfully"
+
+ send "tt load $hashfile\n"
+ expect "Hash loaded successfully"
+
+ send "analyze analyze.epd depth 6\n"
+ expect "info string analyzed"
+
+ send "ttstress $threads 500\n"
+ expect "Probes/second"
+
+ send "latency 3\n"
+ expect "stop-bestmove"
+
  send "quit\n"
  expect eof
 
@@ -140,6 +171,6 @@ do
 
 done
 
-rm -f tsan.supp
+rm -f tsan.supp analyze.epd $hashfile
 
 echo "instrumented testing OK"
@@ -58,4 +58,40 @@ done
 
 rm repeat.exp
 
+# in the deterministic mode, a search with several threads and a node limit
+# should give the same bestmove and final node count every time. The node
+# counts of the info lines sent during the search depend on the timing.
+cat << EOF > deterministic.exp
+ set timeout 30
+ spawn ./stockfish
+ lassign \$argv nodes
+
+ send "uci\n"
+ expect "uciok"
+
+ send "setoption name Threads value 3\n"
+ send "setoption name Deterministic value true\n"
+ send "ucinewgame\n"
+ send "position fen r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP3PPP/R2QKB1R w KQ - 0 9\n"
+ send "go nodes \$nodes\n"
+ expect "bestmove"
+
+ send "quit\n"
+ expect eof
+EOF
+
+for nodes in 50000 200000
+do
+
+  echo "reprosearch testing deterministic mode with $nodes nodes"
+
+  expect deterministic.exp $nodes 2>&1 | grep -oE "nodes [0-9]+|bestmove [a-h1-8]+" | tail -2 > deterministic1.txt
+  expect deterministic.exp $nodes 2>&1 | grep -oE "nodes [0-9]+|bestmove [a-h1-8]+" | tail -2 > deterministic2.txt
+  grep -q bestmove deterministic1.txt
+  diff deterministic1.txt deterministic2.txt
+
+done
+
+rm deterministic.exp deterministic1.txt deterministic2.txt
+
 echo "reprosearch testing OK"